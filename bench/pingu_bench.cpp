@@ -0,0 +1,389 @@
+// Microbenchmarks for the parse, diff, render, streaming and fixture paths
+// over generated documents, and end-to-end runs of a suite by the pingu
+// binary (--parallel and --async, at several widths) against the built-in
+// mock server. Every result is printed on stdout as one JSON line:
+//
+//   {"bench", "params", "iterations", "ns_per_op", "mb_per_s", "items_per_s"}
+//
+// so runs can be appended to a file and compared over time. Build in
+// Release for meaningful numbers.
+//
+//   pingu_bench [--filter <substring>] [--min-time <ms>] [--cases <n>]
+//               [--pingu <path>]
+
+#include "cassette.hpp"
+#include "fixture_cache.hpp"
+#include "json_utils.hpp"
+#include "mock_server.hpp"
+#include "result_sink.hpp"
+#include "stream_validator.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <spawn.h>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#ifndef PINGU_PATH
+#define PINGU_PATH "pingu"
+#endif
+
+extern char **environ;
+
+namespace {
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+struct Settings {
+  std::string filter;
+  double min_time_ms = 300;
+  size_t cases = 200;
+  std::string pingu = PINGU_PATH;
+};
+
+// A generated document: `root_width` children under the root, each a tree
+// of `depth` further levels with `width` children per container. Objects
+// and arrays alternate level by level.
+struct Shape {
+  std::string name;
+  bool array_root;
+  size_t root_width;
+  int depth;
+  size_t width;
+};
+
+const std::vector<Shape> kShapes = {
+    {"small", false, 10, 2, 5},          //    50 leaves
+    {"nested", false, 20, 3, 20},        //  8000 leaves
+    {"deep", false, 2, 12, 2},           //  4096 leaves, 13 levels
+    {"wide_array", true, 10000, 1, 4},   // 40000 leaves in one array
+};
+
+const std::vector<double> kDensities = {0, 0.001, 0.01, 0.1};
+
+json make_leaf(std::mt19937_64 &rng) {
+  switch (rng() % 4) {
+  case 0:
+    return static_cast<int64_t>(rng() % 1000000);
+  case 1:
+    return static_cast<double>(rng() % 100000) / 7.0;
+  case 2:
+    return "value-" + std::to_string(rng() % 100000);
+  default:
+    return rng() % 2 == 0;
+  }
+}
+
+json make_node(std::mt19937_64 &rng, int depth, size_t width, bool object) {
+  if (depth == 0)
+    return make_leaf(rng);
+  json node = object ? json::object() : json::array();
+  for (size_t i = 0; i < width; ++i) {
+    json child = make_node(rng, depth - 1, width, !object);
+    if (object)
+      node["key" + std::to_string(i)] = std::move(child);
+    else
+      node.push_back(std::move(child));
+  }
+  return node;
+}
+
+json make_doc(const Shape &shape, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  json root = shape.array_root ? json::array() : json::object();
+  for (size_t i = 0; i < shape.root_width; ++i) {
+    json child = make_node(rng, shape.depth, shape.width, shape.array_root);
+    if (shape.array_root)
+      root.push_back(std::move(child));
+    else
+      root["field" + std::to_string(i)] = std::move(child);
+  }
+  return root;
+}
+
+// Changes about `density` of the leaves and drops about `density` of the
+// array elements, so aligned arrays get shifted tails as well.
+void mutate(json &node, std::mt19937_64 &rng, double density) {
+  std::uniform_real_distribution<double> coin(0, 1);
+  if (!node.is_structured()) {
+    if (coin(rng) < density)
+      node = "changed-" + node.dump();
+    return;
+  }
+  if (node.is_array() && !node.empty() && coin(rng) < density)
+    node.erase(rng() % node.size());
+  for (auto &child : node)
+    mutate(child, rng, density);
+}
+
+template <typename Fn>
+void run_bench(const Settings &settings, const std::string &name,
+               const json &params, size_t bytes_per_op, size_t items_per_op,
+               Fn &&fn) {
+  if (!settings.filter.empty() &&
+      name.find(settings.filter) == std::string::npos)
+    return;
+
+  fn(); // warm-up: page faults, allocator, caches
+  size_t iterations = 0;
+  double elapsed_ms = 0;
+  auto start = Clock::now();
+  do {
+    fn();
+    ++iterations;
+    elapsed_ms =
+        std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  } while (elapsed_ms < settings.min_time_ms);
+
+  double ns = elapsed_ms * 1e6 / static_cast<double>(iterations);
+  json result = {{"bench", name},
+                 {"params", params},
+                 {"iterations", iterations},
+                 {"ns_per_op", static_cast<long long>(ns)}};
+  if (bytes_per_op)
+    result["mb_per_s"] = static_cast<double>(bytes_per_op) / ns * 1e3;
+  if (items_per_op)
+    result["items_per_s"] = static_cast<double>(items_per_op) / ns * 1e9;
+  std::cout << result.dump() << std::endl;
+}
+
+void bench_documents(const Settings &settings, const std::string &dir) {
+  json_utils::DiffFilter filter;
+
+  for (const auto &shape : kShapes) {
+    json expected = make_doc(shape, 42);
+    std::string expectedText = expected.dump();
+
+    json params = {{"shape", shape.name}, {"bytes", expectedText.size()}};
+    run_bench(settings, "parse", params, expectedText.size(), 0,
+              [&] { json parsed = json::parse(expectedText); });
+
+    std::string path = dir + "/" + shape.name + ".json";
+    std::ofstream(path) << expectedText;
+    run_bench(settings, "fixture_load_cold", params, expectedText.size(), 0,
+              [&] {
+                fixture_cache::FixtureCache cache;
+                cache.load(path);
+              });
+    fixture_cache::FixtureCache warm;
+    run_bench(settings, "fixture_load_warm", params, 0, 0,
+              [&] { warm.load(path); });
+
+    for (double density : kDensities) {
+      json actual = expected;
+      std::mt19937_64 rng(7);
+      mutate(actual, rng, density);
+      std::string actualText = actual.dump();
+
+      json_utils::DiffList diffs;
+      json_utils::diff_collect(expected, actual, filter, diffs);
+      json dparams = {{"shape", shape.name},
+                      {"density", density},
+                      {"bytes", actualText.size()},
+                      {"diffs", diffs.size()}};
+
+      run_bench(settings, "diff_collect", dparams, actualText.size(), 0, [&] {
+        json_utils::DiffList found;
+        json_utils::diff_collect(expected, actual, filter, found);
+      });
+
+      if (!diffs.empty()) {
+        run_bench(settings, "render_diff_compact", dparams, 0, diffs.size(),
+                  [&] {
+                    std::ostringstream out;
+                    json_utils::render_diff_compact(diffs, out);
+                  });
+      }
+
+      run_bench(settings, "stream_validate", dparams, actualText.size(), 0,
+                [&] {
+                  stream_validator::StreamValidator validator(expected, filter,
+                                                              false);
+                  constexpr size_t kChunk = 16 * 1024;
+                  for (size_t pos = 0; pos < actualText.size(); pos += kChunk)
+                    validator.feed(actualText.data() + pos,
+                                   std::min(kChunk, actualText.size() - pos));
+                  validator.finish();
+                });
+    }
+  }
+}
+
+// Runs the pingu binary with `args` and its stdout discarded. Returns its
+// exit status, or -1 when it could not be started or was killed.
+int run_pingu(const std::string &binary, const std::vector<std::string> &args) {
+  std::vector<char *> argv;
+  argv.push_back(const_cast<char *>(binary.c_str()));
+  for (const auto &arg : args)
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null",
+                                   O_WRONLY, 0);
+  pid_t pid;
+  int err = posix_spawn(&pid, binary.c_str(), &actions, nullptr, argv.data(),
+                        environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (err != 0)
+    return -1;
+  int status = 0;
+  if (::waitpid(pid, &status, 0) < 0 || !WIFEXITED(status))
+    return -1;
+  return WEXITSTATUS(status);
+}
+
+// A synthetic suite of `cases` tests, each fetching its own ~15 KiB
+// document from the mock server and diffing it against an identical
+// expected file, run by the pingu binary as a user would.
+bool bench_suite(const Settings &settings, const std::string &dir) {
+  if (!settings.filter.empty() &&
+      std::string("suite_parallel").find(settings.filter) ==
+          std::string::npos &&
+      std::string("suite_async").find(settings.filter) == std::string::npos)
+    return true;
+
+  Shape shape{"suite", false, 10, 2, 10};
+  std::string cassettePath = dir + "/suite.cassette";
+  {
+    cassette::Recorder recorder;
+    if (!recorder.open(cassettePath))
+      return false;
+    for (size_t i = 0; i < settings.cases; ++i) {
+      std::string name = "case" + std::to_string(i);
+      cassette::Interaction interaction;
+      interaction.method = "GET";
+      interaction.target = "/" + name;
+      interaction.status = 200;
+      interaction.headers = {{"Content-Type", "application/json"}};
+      interaction.body = make_doc(shape, i).dump();
+      recorder.record(interaction);
+      std::ofstream(dir + "/" + name + ".expected.json") << interaction.body;
+    }
+  }
+
+  // Port 0: a free port, so nothing else already listening gets measured
+  std::promise<int> listening;
+  mock_server::ServeOptions serveOptions;
+  serveOptions.port = 0;
+  serveOptions.announce = false;
+  serveOptions.on_listening = [&listening](int port) {
+    listening.set_value(port);
+  };
+  std::future<int> port = listening.get_future();
+  std::thread([cassettePath, serveOptions] {
+    mock_server::serve(cassettePath, serveOptions);
+  }).detach();
+  if (port.wait_for(std::chrono::seconds(5)) != std::future_status::ready) {
+    std::cerr << "Mock server did not come up\n";
+    return false;
+  }
+  std::string base = "http://127.0.0.1:" + std::to_string(port.get());
+
+  json cases = json::array();
+  for (size_t i = 0; i < settings.cases; ++i) {
+    std::string name = "case" + std::to_string(i);
+    std::string requestPath = dir + "/" + name + ".request.json";
+    std::ofstream(requestPath)
+        << json{{"method", "GET"}, {"url", base + "/" + name}}.dump();
+    std::string expectedPath = dir + "/" + name + ".expected.json";
+    cases.push_back({{"test_name", name},
+                     {"test_description", "synthetic"},
+                     {"request_description", requestPath},
+                     {"expected_response", expectedPath}});
+  }
+  std::string suitePath = dir + "/suite.json";
+  std::ofstream(suitePath) << json{{"test_suit_name", "synthetic"},
+                                   {"test_cases", cases}}
+                                  .dump();
+
+  // pingu exits 0 even when cases fail, so every run writes an export log
+  // and counts only when all of its cases passed
+  std::string logPath = dir + "/run.jsonl";
+  auto suite_passes = [&](const std::vector<std::string> &mode) {
+    std::vector<std::string> args = {"--test_suit", suitePath, "--export-log",
+                                     logPath};
+    args.insert(args.end(), mode.begin(), mode.end());
+    if (run_pingu(settings.pingu, args) != 0)
+      return false;
+    size_t passed = 0;
+    bool read = result_sink::read_export(logPath, [&](const json &record) {
+      if (record.value("status", "") == "passed")
+        ++passed;
+    });
+    return read && passed == settings.cases;
+  };
+
+  if (!suite_passes({})) {
+    std::cerr << "Synthetic suite did not pass under " << settings.pingu
+              << " (--pingu sets the binary)\n";
+    return false;
+  }
+
+  bool allPassed = true;
+  for (unsigned width : {1u, 4u, 16u, 64u}) {
+    json params = {{"cases", settings.cases}, {"width", width}};
+    std::string n = std::to_string(width);
+    run_bench(settings, "suite_parallel", params, 0, settings.cases, [&] {
+      if (!suite_passes({"--parallel", "--jobs", n}))
+        allPassed = false;
+    });
+    run_bench(settings, "suite_async", params, 0, settings.cases, [&] {
+      if (!suite_passes({"--async", "--max-inflight", n}))
+        allPassed = false;
+    });
+  }
+  if (!allPassed) {
+    std::cerr << "Synthetic suite had failures; the mock server replies are "
+                 "not what was recorded\n";
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Settings settings;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--filter" && i + 1 < argc)
+      settings.filter = argv[++i];
+    else if (arg == "--min-time" && i + 1 < argc)
+      settings.min_time_ms = std::stod(argv[++i]);
+    else if (arg == "--cases" && i + 1 < argc)
+      settings.cases = std::stoul(argv[++i]);
+    else if (arg == "--pingu" && i + 1 < argc)
+      settings.pingu = argv[++i];
+    else {
+      std::cerr << "Usage: pingu_bench [--filter <substring>] [--min-time "
+                   "<ms>] [--cases <n>] [--pingu <path>]\n";
+      return 1;
+    }
+  }
+
+  char dirTemplate[] = "/tmp/pingu_bench.XXXXXX";
+  if (!::mkdtemp(dirTemplate)) {
+    std::cerr << "Failed to create a scratch directory\n";
+    return 1;
+  }
+  std::string dir = dirTemplate;
+
+  bench_documents(settings, dir);
+  bool ok = bench_suite(settings, dir);
+
+  std::filesystem::remove_all(dir);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,48 @@
+#ifndef ARRAY_ALIGN_HPP
+#define ARRAY_ALIGN_HPP
+
+#include <cstddef>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+namespace array_align {
+
+// Two array elements that should be compared with each other. One side is
+// nullptr for an element that only exists in the other array. `index` is
+// the position used in diff paths: the actual index when there is an
+// actual element, otherwise the expected index (align_ordered) or a
+// position past the end of the actual array (align_keyed).
+struct ElementPair {
+  const nlohmann::json *expected;
+  const nlohmann::json *actual;
+  size_t index;
+  bool identical; // known to be deeply equal, no need to compare again
+};
+
+// Aligns two ordered arrays with Myers' O(ND) algorithm in its linear-space
+// (bisecting) form, after trimming the common prefix and suffix. Within each
+// run of deletions and insertions between matched elements, elements are
+// paired up by position so that an element with one changed field is
+// reported as that field, not as a removal plus an addition. Very dissimilar
+// arrays exhaust a work budget and fall back to positional pairing.
+//
+// With a non-zero `offset`, the first `offset` expected elements have already
+// been matched with actual elements that are not passed in; `actual` holds
+// the rest and indices are reported as if the prefix were present.
+std::vector<ElementPair> align_ordered(const nlohmann::json &expected,
+                                       const nlohmann::json &actual,
+                                       size_t offset = 0);
+
+// Matches elements by the value of `field` with a hash join. Returns false
+// (leaving `out` untouched) unless every element on both sides is an object
+// that has the field. Actual elements come first in their own order,
+// followed by expected elements that found no partner, numbered on from
+// the end of the actual array: their expected indices could name an actual
+// element that is reported too.
+bool align_keyed(const nlohmann::json &expected, const nlohmann::json &actual,
+                 const std::string &field, std::vector<ElementPair> &out);
+
+} // namespace array_align
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef CASSETTE_HPP
+#define CASSETTE_HPP
+
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cassette {
+
+// One recorded request and the raw response it got. A cassette is a JSON
+// Lines file with one object per interaction:
+//   {"method", "target", "request_body", "status", "headers", "body"}
+// `target` is the path and query as sent on the request line, so a
+// cassette recorded against one host replays on any other. A body that is
+// not UTF-8 is stored base64-encoded, with "body_encoding" (or
+// "request_body_encoding") set to "base64".
+struct Interaction {
+  std::string method;
+  std::string target;
+  std::string request_body;
+  long status = 0;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string body;
+};
+
+// Path and query of a URL: "https://api.example.com/v1/users?id=1" gives
+// "/v1/users?id=1".
+std::string target_of(const std::string &url);
+
+// Appends interactions to a cassette as transfers finish. Safe to call
+// from any thread.
+class Recorder {
+public:
+  bool open(const std::string &path);
+  void record(const Interaction &interaction);
+  size_t count() const;
+
+private:
+  mutable std::mutex mtx;
+  std::ofstream out;
+  size_t written = 0;
+};
+
+// Reads every interaction of a cassette. Problems are reported on stderr.
+bool load(const std::string &path, std::vector<Interaction> &out);
+
+} // namespace cassette
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef FILE_WATCH_HPP
+#define FILE_WATCH_HPP
+
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace file_watch {
+
+// `path` made absolute against the current directory and normalized, the
+// form in which changes are reported.
+std::string absolute(const std::string &path);
+
+// Reports changes to files through inotify. The directories holding them
+// are watched rather than the files themselves, so editors that save by
+// renaming a new file over the old one are still seen. While a watcher
+// exists, Ctrl-C ends wait() instead of the process; a second one kills the
+// process as usual.
+class Watcher {
+public:
+  Watcher();
+  ~Watcher();
+
+  Watcher(const Watcher &) = delete;
+  Watcher &operator=(const Watcher &) = delete;
+
+  bool ok() const { return fd >= 0; }
+
+  // Whether Ctrl-C was pressed since the watcher was created.
+  bool interrupted() const;
+
+  // Watches the directory of `path`. A directory is only added once, and
+  // one whose name is filled in per row is not watched at all.
+  void add(const std::string &path);
+
+  size_t directories() const { return dirs.size(); }
+
+  // Blocks until something in a watched directory is written, moved in or
+  // deleted, then goes on collecting until `settle` passes quietly, so a
+  // save that touches several files comes back as one batch. Returns the
+  // absolute paths that changed, or nothing once interrupted.
+  std::set<std::string>
+  wait(std::chrono::milliseconds settle = std::chrono::milliseconds(100));
+
+  // Whether the last wait() lost changes, because the kernel's event queue
+  // overflowed or reading it failed. Anything may have changed then.
+  bool missed_changes() const { return missed; }
+
+private:
+  int fd = -1;
+  bool missed = false;
+  void (*previous_handler)(int) = SIG_DFL;
+  std::unordered_map<int, std::string> dirs; // watch descriptor -> path
+  std::unordered_set<std::string> watched;
+};
+
+// Files a suite case reads: its fixtures and its parameter table. Paths
+// may hold {{name}} placeholders that are filled in per row.
+std::vector<std::string> case_files(const nlohmann::json &testCase);
+
+// Cases of `test_cases` that read one of the `changed` files. A path with
+// placeholders matches every file its placeholders could stand for.
+std::vector<size_t> cases_using(const nlohmann::json &test_cases,
+                                const std::set<std::string> &changed);
+
+// Cases of the suite `after` that are new or differ from the case of the
+// same name in `before`. Every case when a suite-level field changed.
+std::vector<size_t> changed_cases(const nlohmann::json &before,
+                                  const nlohmann::json &after);
+
+} // namespace file_watch
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef FIXTURE_CACHE_HPP
+#define FIXTURE_CACHE_HPP
+
+#include "json_utils.hpp"
+#include "suite_bundle.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+
+namespace fixture_cache {
+
+using Document = std::shared_ptr<const nlohmann::json>;
+
+// Parsed request/expected fixtures shared by every test of a run. Files are
+// mapped rather than streamed, and keyed twice: by path, so a file named by
+// many cases is read once, and by a hash of its bytes, so identical files
+// under different names are parsed once (the bytes are compared before a
+// document is shared, so a hash collision only costs a parse). Documents
+// are immutable and handed out by shared pointer, so workers read them
+// concurrently without copies.
+// A file that several workers ask for at the same time is loaded by the
+// first of them while the others wait for its result.
+class FixtureCache {
+public:
+  FixtureCache() = default;
+  FixtureCache(const FixtureCache &) = delete;
+  FixtureCache &operator=(const FixtureCache &) = delete;
+
+  // The parsed file, or nullptr when it cannot be read or is not JSON.
+  // Failures are cached as well.
+  Document load(const std::string &path);
+
+  // Forgets the file at `path` so the next load() reads it again, under
+  // whichever name it was loaded (names are compared as absolute paths).
+  // A load of the file still in flight is waited for. Meant for between
+  // runs: a worker loading the file meanwhile may still get the old
+  // contents. Returns the number of names dropped.
+  size_t invalidate(const std::string &path);
+
+  // Forgets every file, as when all of them may have changed. Loads in
+  // flight finish with the old contents.
+  void clear();
+
+  // `doc` (a document from load()) compiled as a template, once per
+  // document, so cases that fill its placeholders with different values do
+  // not re-scan it every time.
+  std::shared_ptr<const json_utils::Template> template_for(const Document &doc);
+
+  // Serves the fixtures stored in `bundle` from it (decoded on first use)
+  // instead of from the file system. Call before the first load().
+  void set_bundle(std::shared_ptr<const suite_bundle::Bundle> bundle);
+
+  struct Stats {
+    size_t lookups;      // calls to load()
+    size_t files_read;   // distinct paths mapped
+    size_t parsed;       // distinct contents parsed
+    size_t bytes_parsed; // size of those contents
+  };
+  Stats stats() const;
+
+private:
+  // A hash of a loose file's bytes, or the address of a bundled fixture
+  // (the bundle stores identical fixtures once already).
+  struct ContentKey {
+    uint64_t hash;
+    size_t size;
+    bool bundled;
+    bool operator==(const ContentKey &other) const {
+      return hash == other.hash && size == other.size &&
+             bundled == other.bundled;
+    }
+  };
+  struct ContentKeyHash {
+    size_t operator()(const ContentKey &key) const {
+      return static_cast<size_t>(key.hash ^ key.size);
+    }
+  };
+
+  // A parsed content and the file it was read from, to compare the bytes
+  // of a file whose hash matches against.
+  struct Content {
+    std::shared_future<Document> doc;
+    std::string path;
+  };
+
+  Document read_file(const std::string &path);
+
+  std::shared_ptr<const suite_bundle::Bundle> bundle;
+  mutable std::mutex mtx;
+  std::unordered_map<std::string, std::shared_future<Document>> by_path;
+  std::unordered_map<ContentKey, Content, ContentKeyHash> by_content;
+  std::unordered_map<const nlohmann::json *,
+                     std::shared_ptr<const json_utils::Template>>
+      templates;
+  Stats counters{0, 0, 0, 0};
+};
+
+} // namespace fixture_cache
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace histogram {
+
+// HDR-style log-linear histogram of non-negative integer values (latencies
+// in microseconds). Values below 2048 are exact; above that every power of
+// two is split into 1024 linear sub-buckets, so any recorded value is
+// reported within 0.1% of its true value. Recording is O(1) and memory is
+// fixed regardless of the number of samples.
+class Histogram {
+public:
+  Histogram();
+
+  void record(uint64_t value);
+  void merge(const Histogram &other);
+  void reset();
+
+  uint64_t count() const { return total; }
+  uint64_t min() const { return total ? min_value : 0; }
+  uint64_t max() const { return max_value; }
+  double mean() const;
+
+  // Smallest recorded value such that `percentile` percent of all samples
+  // are less than or equal to it. `percentile` is in [0, 100].
+  uint64_t value_at_percentile(double percentile) const;
+
+private:
+  static size_t index_for(uint64_t value);
+  static uint64_t highest_equivalent(size_t index);
+
+  std::vector<uint64_t> counts;
+  uint64_t total = 0;
+  uint64_t min_value = UINT64_MAX;
+  uint64_t max_value = 0;
+  long double sum = 0;
+};
+
+} // namespace histogram
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef HOST_LIMITS_HPP
+#define HOST_LIMITS_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace host_limits {
+
+struct Limit {
+  size_t max_concurrency = 0; // cases in flight at once, 0 = unlimited
+  double rate = 0;            // cases started per second, 0 = unlimited
+  double burst = 1;           // starts allowed back to back after a pause
+};
+
+struct Config {
+  Limit defaults;
+  // Keyed by "host:port" or by "host" for every port
+  std::unordered_map<std::string, Limit> hosts;
+
+  bool empty() const;
+  const Limit &limit_for(const std::string &host) const;
+};
+
+// Reads "host_limits": {"*": {"max_concurrency": 4, "rate": 10, "burst": 5},
+// "api.example.com": {...}} from a suite, where "*" sets the defaults.
+// Returns false and sets `error` when malformed.
+bool parse_config(const nlohmann::json &suite, Config &config,
+                  std::string &error);
+
+// Starts queued work items as the limits of their host allow: no more than
+// max_concurrency in flight per host, and starts paced by a token bucket
+// holding up to `burst` tokens that refills at `rate` per second. Every
+// host has its own queue, so work for other hosts keeps flowing while one
+// is throttled. Items waiting only for tokens are started from a timer
+// thread, so `start` must not block.
+class HostScheduler {
+public:
+  using Start = std::function<void(size_t item)>;
+
+  HostScheduler(Config config, Start start);
+  ~HostScheduler();
+
+  HostScheduler(const HostScheduler &) = delete;
+  HostScheduler &operator=(const HostScheduler &) = delete;
+
+  // Queues `item` for `host`. `cost` tokens are taken when it starts (a
+  // case sending several requests costs more); the bucket may go into debt
+  // so the rate holds on average.
+  void submit(size_t item, const std::string &host, double cost = 1);
+
+  // An item of `host` has finished; frees its slot.
+  void done(const std::string &host);
+
+  // Nothing queued and nothing in flight.
+  bool idle() const;
+
+  // Blocks until idle().
+  void wait_idle();
+
+  struct HostStats {
+    size_t started = 0;
+    size_t max_in_flight = 0;
+    double throttled_ms = 0; // total time items waited in the queue
+  };
+  std::map<std::string, HostStats> stats() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Queued {
+    size_t item;
+    double cost;
+    Clock::time_point since;
+  };
+
+  struct Host {
+    Limit limit;
+    std::deque<Queued> queue;
+    size_t running = 0;
+    double tokens = 0;
+    Clock::time_point refilled;
+    HostStats stats;
+  };
+
+  // Takes every item the limits allow right now off the queues and returns
+  // the earliest time a still-queued item can start.
+  Clock::time_point take_startable(std::vector<size_t> &out);
+  void start_all(const std::vector<size_t> &items);
+  void timer_loop();
+
+  Config config;
+  Start start;
+
+  mutable std::mutex mtx;
+  std::condition_variable timer_cv;
+  std::condition_variable idle_cv;
+  std::unordered_map<std::string, Host> hosts;
+  size_t queued = 0;
+  size_t running = 0;
+  Clock::time_point wake_at = Clock::time_point::max();
+  bool stopping = false;
+  std::thread timer;
+};
+
+} // namespace host_limits
+
+#endif
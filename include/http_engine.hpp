@@ -0,0 +1,103 @@
+#ifndef HTTP_ENGINE_HPP
+#define HTTP_ENGINE_HPP
+
+#include "http_utils.hpp"
+#include "thread_pool.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <curl/curl.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace http_engine {
+
+// Called once per submitted request. `response` holds the parsed body (or the
+// raw string when it is not JSON) and may be moved from. `info.api_time_ms`
+// covers the time from the transfer starting to it completing, so time spent
+// queued behind max_in_flight is not included.
+using Completion = std::function<void(bool ok, nlohmann::json &response,
+                                      const http_utils::ResponseInfo &info)>;
+
+// Event-driven request engine on the libcurl multi interface. A single loop
+// thread drives every transfer through epoll; completions run on the loop
+// thread, or on `completions` when a pool is given so that slow callbacks
+// (diffing, logging) never stall the network.
+class Engine {
+public:
+  explicit Engine(size_t max_in_flight = 0,
+                  thread_pool::ThreadPool *completions = nullptr);
+  ~Engine();
+
+  Engine(const Engine &) = delete;
+  Engine &operator=(const Engine &) = delete;
+
+  bool ok() const { return multi != nullptr; }
+
+  // With `parse_body` false the response is left empty, which keeps
+  // load generation from spending its time in the JSON parser.
+  void submit(const nlohmann::json &request_desc, Completion done,
+              bool parse_body = true);
+
+  // Hands the body to `sink` as it arrives instead of buffering it; the
+  // response passed to `done` is empty. The sink runs on the loop thread,
+  // so it must be cheap per chunk. A transfer aborted by the sink counts as
+  // successful.
+  void submit(const nlohmann::json &request_desc, Completion done,
+              http_utils::BodySink sink);
+
+  // Blocks until every submitted request has completed and its callback
+  // has returned.
+  void wait_idle();
+
+  // Aborts every transfer in flight or still queued; their completions
+  // report a failure. Safe to call from any thread, including completions.
+  void cancel();
+
+private:
+  struct Transfer;
+
+  static int socket_callback(CURL *easy, curl_socket_t fd, int what,
+                             void *userp, void *socketp);
+  static int timer_callback(CURLM *multi, long timeout_ms, void *userp);
+
+  void loop();
+  void start_pending();
+  void abort_all();
+  void drain_completed();
+  void enqueue(std::shared_ptr<Transfer> transfer);
+  void finish(Transfer *transfer, CURLcode result);
+  void complete(const std::shared_ptr<Transfer> &transfer);
+  void wake();
+
+  CURLM *multi = nullptr;
+  int epoll_fd = -1;
+  int wake_fd = -1;
+  std::thread loop_thread;
+  thread_pool::ThreadPool *completions;
+
+  // Loop thread only
+  size_t max_in_flight;
+  std::unordered_map<Transfer *, std::shared_ptr<Transfer>> active;
+  std::vector<CURL *> idle_handles; // reset and reused by later transfers
+  long timer_ms = -1;
+  std::chrono::steady_clock::time_point timer_deadline;
+
+  // Shared with submitters
+  std::mutex mtx;
+  std::condition_variable idle_cv;
+  std::deque<std::shared_ptr<Transfer>> incoming;
+  size_t outstanding = 0;
+  bool stopping = false;
+  bool cancelling = false;
+};
+
+} // namespace http_engine
+
+#endif
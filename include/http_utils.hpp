@@ -1,12 +1,138 @@
 #ifndef HTTP_UTILS_HPP
 #define HTTP_UTILS_HPP
 
+#include "cassette.hpp"
+#include <chrono>
+#include <curl/curl.h>
+#include <functional>
 #include <nlohmann/json.hpp>
 #include <string>
 
 namespace http_utils {
+
+// Receives the response body chunk by chunk as it arrives. Returning false
+// aborts the transfer.
+using BodySink = std::function<bool(const char *data, size_t len)>;
+
+// Buffers that a configured easy handle points into. Must outlive the
+// transfer it was prepared for.
+struct RequestState {
+  std::string url;
+  std::string method;
+  std::string body;
+  std::string response; // unused when a sink is set, unless recording
+  struct curl_slist *headers = nullptr;
+  BodySink sink;
+  bool sink_aborted = false;
+  bool recording = false;       // keep the raw response for the cassette
+  std::string response_headers; // raw header lines, only when recording
+
+  RequestState() = default;
+  RequestState(const RequestState &) = delete;
+  RequestState &operator=(const RequestState &) = delete;
+  ~RequestState();
+};
+
+// Where the time of one test went, in microseconds. Network phases are
+// durations derived from curl's cumulative CURLINFO_*_TIME_T marks:
+//   dns       name lookup
+//   connect   TCP connect after the lookup
+//   tls       TLS handshake after the connect (0 for plain HTTP)
+//   ttfb      request sent until the first response byte (server time)
+//   transfer  first byte until the last byte
+// parse and diff are local work done by Pingu after the transfer.
+struct PhaseTimings {
+  long long dns_us = 0;
+  long long connect_us = 0;
+  long long tls_us = 0;
+  long long ttfb_us = 0;
+  long long transfer_us = 0;
+  long long total_us = 0;
+  long long parse_us = 0;
+  long long diff_us = 0;
+};
+
+void to_json(nlohmann::json &out, const PhaseTimings &phases);
+
+// Transfer metadata reported alongside the parsed response.
+struct ResponseInfo {
+  long status_code = 0;
+  int api_time_ms = 0;
+  PhaseTimings phases;
+};
+
+// Fills status, total time and network phases from a finished transfer.
+void collect_response_info(CURL *curl, ResponseInfo &info);
+
+struct ConnectionStats {
+  long reused;
+  long created;
+};
+
+// Initialises libcurl and the process-wide share. Safe to call repeatedly.
+void global_init();
+
+// Attaches the process-wide share (DNS cache and TLS sessions) to a handle.
+void attach_share(CURL *curl);
+
+// Counts whether the finished transfer on `curl` reused a connection.
+void record_connection(CURL *curl);
+
+ConnectionStats connection_stats();
+
+// Sends every completed transfer to `recorder` (nullptr stops recording).
+// Set before any request starts.
+void set_recorder(cassette::Recorder *recorder);
+
+// Sends every request to `base` ("http://127.0.0.1:8080") instead of the
+// scheme, host and port in its url; the path and query are kept. An empty
+// string restores the original urls. Set before any request starts.
+void set_base_url(const std::string &base);
+
+// The "host:port" a request for `url` is sent to once set_base_url has been
+// applied: host lowercased, the scheme's default port filled in. Empty when
+// the url names no host.
+std::string host_of(const std::string &url);
+
+// Run-wide cancellation. After cancel(), or once the deadline has passed,
+// transfers in progress are aborted from curl's progress callback and new
+// ones fail without being sent. The deadline also caps the timeout of every
+// request, so none outlives it. Set the deadline before any request starts.
+void set_deadline(std::chrono::steady_clock::time_point deadline);
+void cancel();
+bool cancelled();
+
+// Clears cancel() and the deadline before another run in the same process.
+void reset_cancel();
+
+// Prints why a transfer failed, unless it was only cut short by a
+// cancellation.
+void report_error(CURLcode result);
+
+// Hands a successfully completed transfer to the recorder, if one is set.
+void record_transfer(CURL *curl, const RequestState &state);
+
+// Applies url, method, headers, body, timeouts ("timeout_ms",
+// "connect_timeout_ms") and response capture from a request description to
+// an easy handle. Fails without a message once the run is cancelled.
+bool prepare_request(CURL *curl, const nlohmann::json &request_desc,
+                     RequestState &state);
+
+// Parses a response body as JSON, falling back to the raw string. Returns the
+// time spent parsing in microseconds.
+long long parse_response(const std::string &body,
+                         nlohmann::json &response_out);
+
 bool make_request_from_json(const nlohmann::json &request_desc,
-                            nlohmann::json &response_out);
-}
+                            nlohmann::json &response_out,
+                            ResponseInfo *info = nullptr);
+
+// Like make_request_from_json, but hands the body to `sink` instead of
+// buffering and parsing it. A transfer aborted by the sink still counts as
+// successful.
+bool stream_request_from_json(const nlohmann::json &request_desc,
+                              const BodySink &sink,
+                              ResponseInfo *info = nullptr);
+} // namespace http_utils
 
-#endif
\ No newline at end of file
+#endif
@@ -1,9 +1,12 @@
 #ifndef JSON_UTILS_HPP
 #define JSON_UTILS_HPP
 
+#include "path_matcher.hpp"
+#include <memory>
 #include <nlohmann/json.hpp>
+#include <ostream>
 #include <string>
-#include <unordered_set>
+#include <vector>
 
 namespace json_utils {
 
@@ -11,24 +14,156 @@ bool read_json(const std::string &path, nlohmann::json &out);
 
 bool write_json(const std::string &path, const nlohmann::json &data);
 
-bool diff_json(const nlohmann::json &expected, const nlohmann::json &actual,
-               const std::string &path,
-               const std::unordered_set<std::string> &ignore,
-               const std::unordered_set<std::string> &watch, int indent,
-               int level);
+// The value at `path`, written like a diff path ("data.items[0].id", "" for
+// the root), or nullptr when there is none.
+const nlohmann::json *find_path(const nlohmann::json &doc,
+                                const std::string &path);
 
-bool diff_json_compact(const nlohmann::json &expected,
-                       const nlohmann::json &actual, const std::string &path,
-                       const std::unordered_set<std::string> &ignore,
-                       const std::unordered_set<std::string> &watch);
+// Whether any string in `doc` holds a {{name}} placeholder.
+bool has_placeholders(const nlohmann::json &doc);
 
-bool diff_json_collect(const nlohmann::json &expected,
-                       const nlohmann::json &actual, std::stringstream &output,
-                       const std::string &path,
-                       const std::unordered_set<std::string> &ignore,
-                       const std::unordered_set<std::string> &watch,
-                       int indent, int level);
+// Fills the {{name}} placeholders in every string of `doc` (object keys are
+// left alone) from the members of `variables`. A string that is nothing but
+// one placeholder takes the variable's JSON value, so numbers and objects
+// keep their type; inside longer text, strings are inserted as they are and
+// other values as JSON. Returns false and sets `error` on an unknown name.
+bool substitute(nlohmann::json &doc, const nlohmann::json &variables,
+                std::string &error);
+
+// A document with {{name}} placeholders, compiled once and filled as often
+// as needed: the strings that hold placeholders are found and split up
+// front, so a fill copies the document and renders only those strings.
+// Fills exactly like substitute().
+class Template {
+public:
+  explicit Template(std::shared_ptr<const nlohmann::json> doc);
+
+  // Whether the document holds no placeholder at all.
+  bool empty() const { return sites.empty(); }
+
+  // Sets `out` to the filled document. Returns false and sets `error` on
+  // an unknown name.
+  bool fill(const nlohmann::json &variables, nlohmann::json &out,
+            std::string &error) const;
+
+  struct Part {
+    std::string text;
+    bool variable; // `text` is a variable name
+  };
+
+private:
+  struct Site {
+    nlohmann::json::json_pointer where;
+    std::vector<Part> parts;
+  };
+
+  void compile(const nlohmann::json &node,
+               const nlohmann::json::json_pointer &where);
+
+  std::shared_ptr<const nlohmann::json> doc;
+  std::vector<Site> sites;
+};
+
+enum class DiffKind { Added, Removed, Changed };
+
+// One difference between two documents. `expected` and `actual` point into
+// the compared documents and are only valid while those are alive.
+struct DiffEntry {
+  std::string path;               // "a.b[2].c", "" for the root
+  DiffKind kind;
+  const nlohmann::json *expected; // nullptr for Added
+  const nlohmann::json *actual;   // nullptr for Removed
+};
+
+using DiffList = std::vector<DiffEntry>;
+
+// Compiled ignore/watch patterns, stepped along with the diff traversal
+// (see path_matcher.hpp for the pattern syntax). Ignored subtrees and
+// subtrees that cannot contain a watched path are pruned before they are
+// visited. Once a watched path is reached, everything below it is compared.
+class DiffFilter {
+public:
+  DiffFilter() = default;
+  DiffFilter(const std::vector<std::string> &ignore,
+             const std::vector<std::string> &watch);
+
+  struct Cursor {
+    path_matcher::State ignore;
+    path_matcher::State watch;
+    path_matcher::State keys; // in array_keys, which is anchored
+  };
+
+  Cursor root() const;
+  Cursor step(const Cursor &cursor, const std::string &key) const;
+  Cursor step(const Cursor &cursor, size_t index) const;
+
+  // Nothing at or below this path takes part in the comparison.
+  bool pruned(const Cursor &cursor) const;
+
+  // Arrays at paths matching `pattern` pair their elements by the value of
+  // `field` instead of by sequence alignment.
+  void add_array_key(const std::string &pattern, const std::string &field);
+
+  // The key field for the array at `cursor`, or nullptr for ordered
+  // matching. A pattern names the array itself, not the arrays nested below
+  // it; "**" names every array. The first pattern added wins.
+  const std::string *array_key(const Cursor &cursor) const;
+
+  // Comparing array elements by position finds a difference exactly when
+  // aligning them does: there is no watch list and no ignore pattern names
+  // a specific index.
+  bool position_independent() const {
+    return watch.empty() && !ignore.uses_indices();
+  }
+
+  // A difference found exactly at this path is reported. Above a watched
+  // path only values that could contain it (objects or arrays) count.
+  bool reportable(const Cursor &cursor, bool holds_container) const;
+
+private:
+  path_matcher::PathMatcher ignore;
+  path_matcher::PathMatcher watch;
+  path_matcher::PathMatcher array_keys{{}, true};
+  std::vector<std::string> key_fields; // by array_keys pattern
+};
+
+// Walks both documents once, merging the (sorted) keys of every object
+// pair and aligning array elements (see array_align.hpp), and appends the
+// differences to `diffs` in traversal order. Nothing is formatted here.
+// Returns true when at least one difference was found.
+bool diff_collect(const nlohmann::json &expected, const nlohmann::json &actual,
+                  const DiffFilter &filter, DiffList &diffs);
+
+// diff_collect for one value inside a larger comparison, located by
+// `cursor` and `path`. Either side may be nullptr for a value that only
+// exists in the other document.
+bool diff_collect_at(const nlohmann::json *expected,
+                     const nlohmann::json *actual, const DiffFilter &filter,
+                     const DiffFilter::Cursor &cursor, const std::string &path,
+                     DiffList &diffs);
+
+// Aligns and diffs the arrays at `path` when the first `offset` actual
+// elements were already found equal to expected[0, offset) and dropped:
+// `actual` holds only the elements after them.
+bool diff_collect_elements(const nlohmann::json &expected,
+                           const nlohmann::json &actual, size_t offset,
+                           const DiffFilter &filter,
+                           const DiffFilter::Cursor &cursor,
+                           const std::string &path, DiffList &diffs);
+
+// Pretty, nested rendering of a collected diff. Unchanged keys are printed
+// for context, so this re-walks the documents; call it only when `diffs` is
+// not empty.
+void render_diff(const nlohmann::json &expected, const nlohmann::json &actual,
+                 const DiffFilter &filter, const DiffList &diffs,
+                 std::ostream &out, int indent);
+
+// One line per difference, keyed by full path.
+void render_diff_compact(const DiffList &diffs, std::ostream &out);
+
+// [{"path", "kind", "expected", "actual"}, ...] for exports.
+nlohmann::json diff_to_json(const DiffList &diffs);
 
 } // namespace json_utils
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,40 @@
+#ifndef LOAD_RUNNER_HPP
+#define LOAD_RUNNER_HPP
+
+#include "histogram.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <ostream>
+
+namespace load_runner {
+
+struct LoadOptions {
+  double rate_per_sec = 10.0;
+  double duration_sec = 10.0;
+  size_t max_in_flight = 0; // 0 = unbounded
+};
+
+struct LoadReport {
+  uint64_t sent = 0;
+  uint64_t errors = 0; // transport failures and HTTP status >= 400
+  double target_rate = 0;
+  double elapsed_sec = 0;
+  histogram::Histogram latency_us; // measured from the intended send time
+};
+
+// Replays the requests referenced by a test spec (or every case of a suite)
+// round-robin at a fixed rate. Sends are scheduled open-loop: request i is
+// due at start + i / rate whether or not earlier requests have returned, and
+// its latency is measured from that due time, so a stalled server shows up
+// in the tail instead of silently lowering the send rate.
+bool run_load(const nlohmann::json &spec, const LoadOptions &options,
+              LoadReport &report);
+
+void print_report(const LoadReport &report, std::ostream &out);
+
+nlohmann::json report_to_json(const LoadReport &report);
+
+} // namespace load_runner
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace mapped_file {
+
+// Read-only private mapping of a whole file, unmapped on destruction.
+// `ok` is false when the file cannot be opened or is not a regular file;
+// an empty file is ok with a null `data`.
+class MappedFile {
+public:
+  // `sequential` tells the kernel the file is read front to back once.
+  explicit MappedFile(const std::string &path, bool sequential = false);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool ok = false;
+  const char *data = nullptr;
+  size_t size = 0;
+};
+
+} // namespace mapped_file
+
+#endif
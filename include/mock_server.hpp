@@ -0,0 +1,27 @@
+#ifndef MOCK_SERVER_HPP
+#define MOCK_SERVER_HPP
+
+#include <functional>
+#include <string>
+
+namespace mock_server {
+
+struct ServeOptions {
+  int port = 8080; // 0: any free port
+  int latency_ms = 0; // added before every response
+  bool announce = true; // print the address being served on stdout
+  // Called with the port once the server listens
+  std::function<void(int port)> on_listening;
+};
+
+// Replays the responses of a cassette over HTTP/1.1 on 127.0.0.1 until the
+// process is stopped. Requests are matched on method and target, then on
+// the request body when several recordings share them; repeated matches
+// cycle through the recordings in order. Each connection gets its own
+// thread, keep-alive is honoured and Nagle is off, so loopback round trips
+// stay in the tens of microseconds. Returns only on a startup error.
+bool serve(const std::string &cassette_path, const ServeOptions &options);
+
+} // namespace mock_server
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef PARAM_TABLE_HPP
+#define PARAM_TABLE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+
+namespace param_table {
+
+// Whether a suite case is a template run once per row of a "parameters"
+// table.
+bool is_parameterized(const nlohmann::json &testCase);
+
+// Streams the rows of a "parameters" table: an inline array of objects, or
+// the path of a CSV file (the header line names the columns; every value is
+// a string) or a JSON Lines file (".jsonl", one object per line). Files are
+// read one row at a time, so a table of any length takes constant memory.
+class Reader {
+public:
+  // Returns nullptr and sets `error` when the table cannot be opened.
+  static std::unique_ptr<Reader> open(const nlohmann::json &parameters,
+                                      std::string &error);
+  virtual ~Reader() = default;
+
+  // The next row as {"column": value}. False at the end of the table, or
+  // on a malformed row, in which case error() says why.
+  virtual bool next(nlohmann::json &row) = 0;
+
+  const std::string &error() const { return failure; }
+
+protected:
+  std::string failure;
+};
+
+// Turns parameterized cases into numbered cases, one row at a time, while
+// the run is going. Every field of the case is filled from the row like the
+// {{name}} placeholders of chained tests, and the fixtures are filled by
+// the test runner from the row as variables. Only the cases handed out and
+// not yet released are kept. Ids start after the suite's own indices.
+class Expander {
+public:
+  // At most `window` generated cases are out at once.
+  Expander(const nlohmann::json &test_cases, size_t window);
+
+  Expander(const Expander &) = delete;
+  Expander &operator=(const Expander &) = delete;
+
+  // Queues the table of test_cases[index]; false with `error` when it
+  // cannot be opened.
+  bool add(size_t index, std::string &error);
+
+  // Generates the next case, waiting while `window` cases are out. False
+  // once every table is used up. When `error` is set, the row (or the rest
+  // of its table) could not be read; the id still names a case that must
+  // be released.
+  bool next(size_t &id, std::string &error);
+
+  bool generated(size_t id) const { return id >= first_id; }
+
+  // The generated case, its row and the case it came from. Valid until
+  // release(id).
+  const nlohmann::json &spec(size_t id) const;
+  const nlohmann::json &row(size_t id) const;
+  size_t parent(size_t id) const;
+
+  void release(size_t id);
+
+private:
+  struct Table {
+    size_t index;
+    std::unique_ptr<Reader> reader;
+    size_t rows = 0;
+  };
+  struct Generated {
+    size_t parent;
+    nlohmann::json spec;
+    nlohmann::json row;
+  };
+
+  const nlohmann::json &test_cases;
+  const size_t first_id;
+  const size_t window;
+  size_t next_id;
+  std::deque<Table> tables;
+
+  mutable std::mutex mtx;
+  std::condition_variable room_cv;
+  std::unordered_map<size_t, Generated> live;
+};
+
+} // namespace param_table
+
+#endif
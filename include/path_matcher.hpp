@@ -0,0 +1,86 @@
+#ifndef PATH_MATCHER_HPP
+#define PATH_MATCHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace path_matcher {
+
+// Active position of a traversal inside the compiled patterns.
+struct State {
+  std::vector<uint32_t> nodes; // live trie nodes, sorted and unique
+  bool matched = false;        // this path or one of its ancestors matched
+  bool concrete = false;       // a live node is not just a `**` self-loop
+};
+
+// No pattern ends here (see PathMatcher::matched_pattern).
+constexpr size_t kNoPattern = SIZE_MAX;
+
+// Path patterns compiled into a trie that is stepped alongside a JSON
+// traversal, so the cost per visited key is independent of the number of
+// patterns. Syntax, segments separated by '.':
+//   name    exact object key
+//   *       any single object key
+//   **      any number (including zero) of keys or array indices
+//   [n]     array element n, may follow a key: items[0]
+//   [*]     any array element: items[*].id
+class PathMatcher {
+public:
+  PathMatcher();
+  // An `anchored` matcher only matches the paths its patterns end at, not
+  // what lies below them: `matched` is not inherited and the trie is
+  // followed past a match.
+  explicit PathMatcher(const std::vector<std::string> &patterns,
+                       bool anchored = false);
+
+  void add(const std::string &pattern);
+  bool empty() const { return pattern_count == 0; }
+  // Some pattern names a specific array index ("items[0]").
+  bool uses_indices() const { return indexed; }
+
+  State root() const;
+  State step_key(const State &state, const std::string &key) const;
+  State step_index(const State &state, size_t index) const;
+
+  // Matches a concrete path such as "orders[3].lines" in one go.
+  bool matches(const std::string &path) const;
+
+  // The first pattern added (counting from 0) that ends at this state's
+  // path, or kNoPattern. Only meaningful for an anchored matcher.
+  size_t matched_pattern(const State &state) const;
+
+  // Nothing at or below this path can match any more.
+  static bool dead(const State &state) {
+    return !state.matched && state.nodes.empty();
+  }
+
+private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  struct Node {
+    std::unordered_map<std::string, uint32_t> keys;
+    std::unordered_map<size_t, uint32_t> indices;
+    uint32_t any_key = kNone;
+    uint32_t any_index = kNone;
+    uint32_t globstar = kNone;
+    bool is_globstar = false;
+    bool terminal = false;
+    size_t pattern = kNoPattern; // first pattern ending here
+  };
+
+  uint32_t new_node(bool is_globstar = false);
+  void add_closure(uint32_t node, std::vector<uint32_t> &out) const;
+  State finish(std::vector<uint32_t> &next, bool matched) const;
+
+  std::vector<Node> nodes;
+  size_t pattern_count = 0;
+  bool indexed = false;
+  bool anchored = false;
+};
+
+} // namespace path_matcher
+
+#endif
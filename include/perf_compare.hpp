@@ -0,0 +1,51 @@
+#ifndef PERF_COMPARE_HPP
+#define PERF_COMPARE_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace perf_compare {
+
+struct CompareOptions {
+  // Smallest change of the median latency worth flagging, in percent
+  double threshold_percent = 10;
+  // Significance level of the one-sided Mann-Whitney U test
+  double alpha = 0.05;
+};
+
+struct CompareSummary {
+  int compared = 0;
+  int slower = 0;
+  int faster = 0;
+  int untested = 0; // too few samples for a significance test
+  int only_baseline = 0;
+  int only_current = 0;
+};
+
+// Smallest one-sided p-value the U test can give for these sample sizes:
+// 1 / C(n1 + n2, n1).
+double min_p_value(size_t n1, size_t n2);
+
+// One-sided Mann-Whitney U test that `current` tends to be larger than
+// `baseline` (or smaller when `larger` is false), by the normal
+// approximation with tie and continuity correction.
+double u_test_p_value(const std::vector<double> &baseline,
+                      const std::vector<double> &current, bool larger);
+
+// Compares the per-test latencies of two --export-log files (JSON or JSON
+// Lines) and prints one line per test found in both. Samples are the
+// "samples_ms" of repeated cases, or the single transfer time otherwise; a
+// name recorded several times pools its samples. A test is flagged slower
+// when its median grew by more than the threshold and the growth is
+// significant at `alpha`. With too few samples for the test to ever reach
+// `alpha`, the threshold alone decides. Returns false when a file cannot
+// be read.
+bool compare(const std::string &baseline_path, const std::string &current_path,
+             const CompareOptions &options, std::ostream &out,
+             CompareSummary &summary);
+
+} // namespace perf_compare
+
+#endif
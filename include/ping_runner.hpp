@@ -0,0 +1,54 @@
+#ifndef PING_RUNNER_HPP
+#define PING_RUNNER_HPP
+
+#include "http_utils.hpp"
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace ping_runner {
+
+struct PingOptions {
+  int timeout_ms = 5000; // per attempt, enforced by curl
+  int retries = 1;       // attempts per probe in single-shot mode
+  int interval_ms = 1000;
+  // Probes per target in continuous mode; 0 keeps going until Ctrl-C.
+  int count = 0;
+  // Probe every `interval_ms` and report statistics. Otherwise each target
+  // is probed once, retrying up to `retries` times `interval_ms` apart.
+  bool continuous = false;
+};
+
+struct TargetReport {
+  std::string url;
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  double min_ms = 0;
+  double max_ms = 0;
+  double mean_ms = 0;
+  double m2 = 0;            // running sum of squared deviations (Welford)
+  double jitter_ms = 0;     // mean |latency - previous latency|
+  uint64_t jitter_samples = 0;
+  double last_ms = -1;
+  http_utils::PhaseTimings phase_sums; // over received probes
+
+  void record(double latency_ms, const http_utils::PhaseTimings &phases);
+  double stddev_ms() const;
+  double loss_percent() const;
+};
+
+// Probes every url concurrently, one thread per target. Each probe fetches
+// the url without parsing the body; latency is curl's total transfer time.
+// Returns true when every target answered at least once.
+bool run_ping(const std::vector<std::string> &urls, const PingOptions &options,
+              std::vector<TargetReport> &reports);
+
+void print_report(const std::vector<TargetReport> &reports, std::ostream &out);
+
+nlohmann::json report_to_json(const std::vector<TargetReport> &reports);
+
+} // namespace ping_runner
+
+#endif
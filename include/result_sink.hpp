@@ -0,0 +1,86 @@
+#ifndef RESULT_SINK_HPP
+#define RESULT_SINK_HPP
+
+#include "test_runner.hpp"
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace result_sink {
+
+// Receives each test result as soon as it finishes: prints its log, appends
+// it to the export file and flushes, and redraws a progress line. Nothing is
+// kept per test, so memory does not grow with the size of the suite.
+// Safe to call from any thread.
+class ResultSink {
+public:
+  // The progress line goes to stderr, and only when stderr is a terminal.
+  ResultSink(std::ostream &console, size_t total);
+  ~ResultSink();
+
+  ResultSink(const ResultSink &) = delete;
+  ResultSink &operator=(const ResultSink &) = delete;
+
+  // A path ending in ".jsonl" gets one JSON record per line. Anything else
+  // gets the usual {"test_suite_name", "results": [...]} document, written
+  // record by record; a null suite name leaves the field out.
+  bool open_export(const std::string &path, const nlohmann::json &suite_name);
+
+  void add(const std::string &name,
+           const test_runner::TestExecutionResult &result,
+           const std::string &log);
+
+  // Raises the number of results to expect, for cases generated while the
+  // run is going.
+  void add_total(size_t more);
+
+  // Completes the export file. The progress line is already gone by the
+  // time the last result is added.
+  void finish();
+
+  int passed() const { return pass_count; }
+  int failed() const { return fail_count; }
+
+private:
+  void clear_progress();
+  void draw_progress(bool force);
+
+  std::ostream &console;
+  size_t total;
+  bool progress;
+
+  std::mutex mtx;
+  std::ofstream export_file;
+  std::string export_path;
+  bool json_lines = false;
+  bool first_record = true;
+  bool finished = false;
+
+  int pass_count = 0;
+  int fail_count = 0;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point last_draw;
+};
+
+// Calls `fn` with every result record of an export written by ResultSink,
+// in either form, and stores the suite name when there is one. Problems are
+// reported on stderr.
+bool read_export(const std::string &path,
+                 const std::function<void(const nlohmann::json &)> &fn,
+                 nlohmann::json *suite_name = nullptr);
+
+// Combines the exports of several shards into one at `out_path` (again
+// JSON Lines when it ends in ".jsonl") and prints overall pass/fail counts
+// and timing totals, per shard and in sum.
+bool merge_exports(const std::vector<std::string> &inputs,
+                   const std::string &out_path);
+
+} // namespace result_sink
+
+#endif
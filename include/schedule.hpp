@@ -0,0 +1,48 @@
+#ifndef SCHEDULE_HPP
+#define SCHEDULE_HPP
+
+#include <cstddef>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace schedule {
+
+// Expected duration in milliseconds per test name.
+using History = std::unordered_map<std::string, double>;
+
+// Reads the per-test `test_time_ms` from a previous --export-log file, in
+// either the JSON or the JSON Lines form. A name seen several times gets
+// the mean of its timings. Problems are reported on stderr.
+bool load_history(const std::string &path, History &out);
+
+// Parses "i/N" (1 <= i <= N) into a 0-based shard index and a count.
+bool parse_shard(const std::string &spec, size_t &index, size_t &count);
+
+// The cases of shard `index` out of `count`, in file order. Every process
+// given the same suite and history gets the same split. Cases linked by
+// "depends_on" form one unit that stays on one shard. Without a history
+// units are dealt round-robin; with one, each unit (longest summed time
+// first) goes to the shard with the least expected work so far, so shards
+// finish at about the same time.
+std::vector<size_t> shard(const nlohmann::json &test_cases,
+                          const History *history, size_t index, size_t count);
+
+struct Plan {
+  std::vector<size_t> order; // indices into the suite's test_cases
+  size_t known = 0;          // cases with a timing in the history
+  double predicted_ms = 0;   // makespan of `order` on `workers` slots
+};
+
+// Longest-expected-first (LPT) order of the `cases` of `test_cases`. Cases
+// missing from the history are estimated at the median of the known ones;
+// ties keep the given order. The predicted makespan assumes each case
+// starts on the first free slot, which is how the pool and the async
+// engine dispatch.
+Plan plan(const nlohmann::json &test_cases, const std::vector<size_t> &cases,
+          const History &history, size_t workers);
+
+} // namespace schedule
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef STREAM_VALIDATOR_HPP
+#define STREAM_VALIDATOR_HPP
+
+#include "json_utils.hpp"
+#include <cstddef>
+#include <deque>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace stream_validator {
+
+// Checks a JSON response against the expected document while it is being
+// received, without building the response DOM. Chunks are fed as they
+// arrive from the transfer; objects and arrays that also exist in the
+// expected document are compared member by member as they stream past.
+//
+// Array elements are buffered one at a time and dropped as soon as they
+// equal the expected element at the same position. From the first element
+// that differs, the rest of the array is kept and aligned at its closing
+// bracket exactly as diff_collect would. Arrays matched by an "array_key"
+// are buffered whole. finish() puts the differences in diff_collect's
+// order, so they are reported as in the buffered mode.
+// Peak memory is therefore bounded by the largest array element (plus any
+// differing tail) rather than by the body.
+//
+// With `fail_fast` the validator stops at the first difference so the
+// caller can abort the transfer. Where the filter allows it (see
+// DiffFilter::position_independent) array elements are then compared by
+// position, so a differing element stops the transfer right away; the
+// verdict is the same, only the reported paths may be positional.
+class StreamValidator {
+public:
+  StreamValidator(const nlohmann::json &expected,
+                  const json_utils::DiffFilter &filter, bool fail_fast);
+
+  StreamValidator(const StreamValidator &) = delete;
+  StreamValidator &operator=(const StreamValidator &) = delete;
+
+  // Consumes the next chunk of the body. Returns false once the validator
+  // has stopped (syntax error, or a difference in fail-fast mode); the
+  // rest of the body is then of no interest.
+  bool feed(const char *data, size_t len);
+
+  // Marks the end of the body. Reports a truncated document and orders
+  // diffs() as diff_collect would.
+  void finish();
+
+  bool stopped() const { return stop; }
+
+  // Non-empty when the body is not (complete) JSON.
+  const std::string &error() const { return syntax_error; }
+
+  // Differences found so far. Entries point into the expected document and
+  // into values owned by the validator.
+  const json_utils::DiffList &diffs() const { return found; }
+
+private:
+  enum class Expect { Value, KeyOrEnd, Key, Colon, CommaOrEnd, ValueOrEnd,
+                      Done };
+  enum class Token { None, String, Number, Literal };
+
+  // Where the next value goes in the comparison.
+  struct Slot {
+    const nlohmann::json *expected = nullptr;
+    json_utils::DiffFilter::Cursor cursor;
+    bool element = false; // array element, always buffered
+  };
+
+  // An object or array that exists on both sides and is compared while it
+  // streams.
+  struct Frame {
+    bool is_object;
+    const nlohmann::json *expected;
+    json_utils::DiffFilter::Cursor cursor;
+    size_t path_mark; // length of this container's path
+
+    // Objects
+    Slot member;
+    std::unordered_set<std::string> seen;
+    size_t matched = 0; // seen keys that exist in `expected`
+
+    // Arrays
+    bool positional = false; // fail-fast: compare elements by index
+    bool buffering = false;  // an element differed, keep the tail
+    size_t index = 0;       // actual elements seen so far
+    size_t offset = 0;      // leading elements equal to the expected ones
+    nlohmann::json tail;
+  };
+
+  void fail(const std::string &message);
+  bool lex(char c);
+  void end_token();
+  bool end_number();
+  bool end_literal();
+
+  // Parser events
+  void begin_container(bool is_object);
+  void end_container();
+  void key(std::string &&name);
+  void scalar(nlohmann::json &&value);
+
+  void value_done();
+  bool value_allowed() const;
+  void append_codepoint();
+
+  Slot next_slot();
+  void capture_value(nlohmann::json &&value, bool container);
+  void resolve(const Slot &slot, nlohmann::json &&value);
+  void resolve_element(Frame &frame, nlohmann::json &&value);
+  void close_object(Frame &frame);
+  void close_array(Frame &frame);
+  void record(const nlohmann::json *expected, nlohmann::json &&actual,
+              const json_utils::DiffFilter::Cursor &cursor);
+  void check_stop();
+  void sort_diffs();
+  void set_path(const Frame &frame, const std::string &key);
+  void set_path(const Frame &frame, size_t index);
+
+  const nlohmann::json &expected;
+  const json_utils::DiffFilter &filter;
+  bool fail_fast;
+
+  // Lexer
+  Expect expect = Expect::Value;
+  Token token = Token::None;
+  bool token_is_key = false;
+  bool escape = false;
+  int unicode_digits = -1; // hex digits still to read in a \u escape
+  unsigned unicode_value = 0;
+  unsigned high_surrogate = 0;
+  std::string text;
+  std::vector<char> nesting;
+  size_t offset_in_body = 0;
+
+  // Comparison
+  std::vector<Frame> frames;
+  std::string path;
+  size_t skip_depth = 0; // inside a pruned subtree
+
+  // Buffering of a value that is compared as a whole
+  Slot capture_slot;
+  nlohmann::json captured;
+  std::vector<nlohmann::json *> capture_stack;
+  std::string capture_key;
+  bool capturing = false;
+
+  json_utils::DiffList found;
+  std::deque<nlohmann::json> owned; // actual values referenced by `found`
+  std::string syntax_error;
+  bool stop = false;
+};
+
+} // namespace stream_validator
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SUITE_BUNDLE_HPP
+#define SUITE_BUNDLE_HPP
+
+#include "mapped_file.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+
+namespace suite_bundle {
+
+// A suite and every fixture it references in one file:
+//
+//   0   magic "PINGUBN" + format version byte
+//   8   index offset (uint64, little endian)
+//   16  index size (uint64, little endian)
+//   24  fixtures, each one CBOR document, identical ones stored once
+//   ..  index: CBOR {"suite": <spec>, "fixtures": {path: [offset, size]}}
+//
+// Fixture paths stay as written in the suite, so a bundle runs from the
+// same working directory as the loose suite would.
+
+// Resolves and deduplicates the fixtures of `suite_path` and writes the
+// bundle to `out_path`. Problems are reported on stderr.
+bool compile(const std::string &suite_path, const std::string &out_path);
+
+// The file starts with the bundle magic.
+bool is_bundle(const std::string &path);
+
+class Bundle {
+public:
+  // Maps the bundle and decodes only its index. nullptr (after a message
+  // on stderr) when the file is not a valid bundle.
+  static std::shared_ptr<const Bundle> open(const std::string &path);
+
+  const nlohmann::json &suite() const { return suite_spec; }
+
+  // The encoded fixture stored for `path`. Returns false when the bundle
+  // does not contain it.
+  bool find(const std::string &path, const char *&data, size_t &size) const;
+
+  // Decodes one fixture, as returned by find().
+  static nlohmann::json decode(const char *data, size_t size);
+
+  explicit Bundle(const std::string &path) : file(path) {}
+
+private:
+  struct Blob {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  mapped_file::MappedFile file;
+  nlohmann::json suite_spec;
+  std::unordered_map<std::string, Blob> fixtures;
+};
+
+} // namespace suite_bundle
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef TEST_GRAPH_HPP
+#define TEST_GRAPH_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace test_graph {
+
+// Whether any case of the suite uses "depends_on" or "extract".
+bool is_chained(const nlohmann::json &test_cases);
+
+// For every case, the first case of the chain it belongs to: cases linked
+// by "depends_on" in either direction share it, a case outside any chain
+// is its own.
+std::vector<size_t> components(const nlohmann::json &test_cases);
+
+// `cases` together with everything downstream of them, and everything those
+// depend on: the cases to run again when `cases` changed, in suite order.
+std::vector<size_t> related(const nlohmann::json &test_cases,
+                            const std::vector<size_t> &cases);
+
+// Cases released by a finished case.
+struct Release {
+  std::vector<size_t> ready;
+  // Cases that will not run, with the name of the failed dependency
+  std::vector<std::pair<size_t, std::string>> skipped;
+};
+
+// The "depends_on" edges between the cases of one run. A case becomes ready
+// as soon as the last of its dependencies has passed, so independent chains
+// run side by side. When a dependency fails, everything downstream of it
+// is skipped. Safe to call from any thread once built.
+class Graph {
+public:
+  // Resolves the "depends_on" names (one name or a list) of `cases`,
+  // indices into `test_cases`. Fails on unknown or ambiguous names, on
+  // dependencies outside `cases` (e.g. in another shard), on cycles, and
+  // on cases with "parameters" taking part in a chain.
+  bool build(const nlohmann::json &test_cases,
+             const std::vector<size_t> &cases, std::string &error);
+
+  // Cases without dependencies, in the order given to build().
+  std::vector<size_t> roots() const;
+
+  // Records the outcome of `index`. `extracted` holds the values the case
+  // pulled out of its response; they are handed down to its dependents.
+  Release finish(size_t index, bool passed, const nlohmann::json &extracted);
+
+  // Values for the {{name}} placeholders of a ready case: everything its
+  // ancestors extracted. Parents are merged in "depends_on" order, later
+  // ones overriding earlier ones.
+  nlohmann::json variables(size_t index) const;
+
+private:
+  struct Node {
+    std::string name;
+    std::vector<size_t> parents;
+    std::vector<size_t> children;
+    size_t waiting = 0;     // parents still to finish
+    std::string failed_dep; // first dependency that failed or was skipped
+    nlohmann::json scope = nlohmann::json::object();
+    bool passed = false;
+  };
+
+  void release(size_t index, Release &out);
+
+  mutable std::mutex mtx;
+  std::vector<size_t> order;
+  std::unordered_map<size_t, Node> nodes;
+};
+
+} // namespace test_graph
+
+#endif
@@ -1,20 +1,102 @@
 #ifndef TEST_RUNNER_HPP
 #define TEST_RUNNER_HPP
 
+#include "fixture_cache.hpp"
+#include "http_engine.hpp"
+#include <functional>
 #include <nlohmann/json.hpp>
+#include <sstream>
 #include <string>
-#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace test_runner {
+
+// Latency limits in milliseconds, checked against the total transfer time
+// of every run of a test. The default maximum of 0 (parse_budget() only
+// accepts positive ones) or an empty list leaves that limit out.
+struct LatencyBudget {
+  double max_ms = 0;
+  // {95, 250}: the 95th percentile of the runs must be at most 250 ms
+  std::vector<std::pair<double, double>> percentiles;
+};
+
+// Applies "max_latency_ms" and "latency_budget": {"p50": 100, "p99.9": 400}
+// from a suite or test case on top of `budget`; each field present replaces
+// the inherited one. Returns false and sets `error` when malformed.
+bool parse_budget(const nlohmann::json &spec, LatencyBudget &budget,
+                  std::string &error);
+
+// Logs every limit `samples` (run times in ms) break to `logOut`, with
+// percentiles taken by nearest rank. Returns true when one was broken.
+bool check_budget(const LatencyBudget &budget, std::vector<double> samples,
+                  std::stringstream &logOut);
+
+struct RunOptions {
+  bool print_compact = false;
+  int verbosity = 1;
+  // Validate responses while they are received instead of parsing them
+  // whole (also enabled per test with "stream": true). Differences are
+  // always printed compact in this mode.
+  bool stream = false;
+  // Abort a streamed transfer at the first difference.
+  bool fail_fast = false;
+  // Parsed fixtures shared by the whole run; files are read per test when
+  // null.
+  fixture_cache::FixtureCache *fixtures = nullptr;
+  // Suite-wide limits; a case's own fields take precedence.
+  LatencyBudget budget;
+  // Values for {{name}} placeholders in the case's fixtures, read only
+  // while run_test() or run_test_async() is being called, so they may live
+  // on the caller's stack. Placeholders are left alone when null.
+  const nlohmann::json *variables = nullptr;
+  // The parameterized suite case this one was generated from, if any. A
+  // fixture whose path there holds placeholders is read for this test only,
+  // bypassing `fixtures`.
+  const nlohmann::json *source = nullptr;
+};
+
 struct TestExecutionResult {
   bool failed;
   int api_time_ms;
   int test_time_ms;
+  http_utils::PhaseTimings phases;
+  nlohmann::json diff; // json_utils::diff_to_json records, empty on success
+  // Latency of every run that got a response, only kept for "repeat": N
+  std::vector<double> samples_ms;
+  // {"name": value} pulled out of the response by the case's "extract"
+  nlohmann::json extracted;
 };
 
-TestExecutionResult run_test(const nlohmann::json &testSpec, bool printCompact,
-                             int verbosity, std::stringstream &logOut);
+using TestCallback =
+    std::function<void(const TestExecutionResult &result,
+                       std::stringstream &logOut)>;
+
+// A case with "repeat": N sends its request N times and checks every
+// response. The log shows the first failing run, api_time_ms is the median
+// run, phases are those of the last run and test_time_ms covers all runs.
+// Latency limits are checked over all runs that got a response. Runs still
+// to come are dropped once http_utils::cancelled().
+// "extract": {"name": "data.id"} stores the value at that path of the
+// response (see json_utils::find_path) in `extracted`; a missing value fails
+// the test. Such cases are never streamed, since extraction needs the whole
+// document.
+TestExecutionResult run_test(const nlohmann::json &testSpec,
+                             const RunOptions &options,
+                             std::stringstream &logOut);
+
+// Loads the fixtures, hands the request to `engine` and returns immediately.
+// `done` is invoked from the engine's completion context.
+void run_test_async(const nlohmann::json &testSpec, const RunOptions &options,
+                    http_engine::Engine &engine, TestCallback done);
+
+// The result of a case that is not run, e.g. because a dependency failed;
+// `reason` completes "Skipped: " in the log.
+TestExecutionResult skip_test(const nlohmann::json &testSpec,
+                              const std::string &reason,
+                              const RunOptions &options,
+                              std::stringstream &logOut);
 
 } // namespace test_runner
 
-#endif
\ No newline at end of file
+#endif
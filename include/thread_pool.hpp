@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace thread_pool {
+
+// Fixed-size work-stealing pool. Every worker owns a deque; tasks submitted
+// from outside the pool are spread round-robin, tasks submitted from a worker
+// go to its own deque. Idle workers steal from the back of other deques.
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned workers = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> task);
+
+  // Blocks until every submitted task has finished.
+  void wait_idle();
+
+  unsigned size() const { return static_cast<unsigned>(threads.size()); }
+
+  // Hardware concurrency, never less than 1.
+  static unsigned default_workers();
+
+private:
+  struct WorkQueue {
+    std::mutex mtx;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void worker_loop(unsigned self);
+  bool take_task(unsigned self, std::function<void()> &out);
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::vector<std::thread> threads;
+
+  std::mutex state_mtx;
+  std::condition_variable work_cv;
+  std::condition_variable idle_cv;
+  size_t queued = 0;  // tasks sitting in a deque
+  size_t pending = 0; // tasks queued or running
+  unsigned next_queue = 0;
+  bool stopping = false;
+};
+
+} // namespace thread_pool
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace trace {
+
+// Self-profiling in Chrome trace-event format (chrome://tracing, Perfetto).
+// Every thread appends complete events to its own buffer without locking;
+// buffers are only merged when the trace is written. While tracing is off
+// a span costs one relaxed atomic load.
+
+namespace detail {
+extern std::atomic<bool> active;
+int64_t now_ns();
+void record(const char *name, int64_t start_ns, int64_t end_ns);
+} // namespace detail
+
+inline bool enabled() {
+  return detail::active.load(std::memory_order_relaxed);
+}
+
+// Starts recording. Call before the threads to be traced do any work.
+void start();
+
+// Stops recording and writes every buffer to `path` as a JSON trace.
+// Call once the traced threads are idle. Problems are reported on stderr.
+bool write(const std::string &path);
+
+// Names the calling thread in the trace.
+void set_thread_name(const std::string &name);
+
+// An overlapping interval that does not belong on a thread track, such as
+// a transfer on the async engine. `id` tells concurrent intervals apart.
+void record_async(const char *name, uint64_t id, int64_t start_ns,
+                  int64_t end_ns);
+
+// Nanoseconds on the trace clock, or 0 while tracing is off.
+inline int64_t now() { return enabled() ? detail::now_ns() : 0; }
+
+// Records the enclosing scope. `name` must be a string literal.
+class Span {
+public:
+  explicit Span(const char *name)
+      : name(enabled() ? name : nullptr),
+        start(this->name ? detail::now_ns() : 0) {}
+  ~Span() {
+    if (name)
+      detail::record(name, start, detail::now_ns());
+  }
+
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+private:
+  const char *name;
+  int64_t start;
+};
+
+} // namespace trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) trace::Span TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#endif
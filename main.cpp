@@ -1,22 +1,36 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <thread>
-#include <mutex>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
 
+#include "cassette.hpp"
+#include "file_watch.hpp"
+#include "fixture_cache.hpp"
 #include "json_utils.hpp"
 #include "http_utils.hpp"
+#include "http_engine.hpp"
+#include "host_limits.hpp"
+#include "load_runner.hpp"
+#include "mock_server.hpp"
+#include "param_table.hpp"
+#include "perf_compare.hpp"
+#include "ping_runner.hpp"
+#include "result_sink.hpp"
+#include "schedule.hpp"
+#include "suite_bundle.hpp"
+#include "test_graph.hpp"
 #include "test_runner.hpp"
-
-struct TestResult {
-    std::string name;
-    bool failed;
-    int api_time_ms;
-    int test_time_ms;
-    std::stringstream log;
-};
+#include "thread_pool.hpp"
+#include "trace.hpp"
 
 void print_help() {
     std::cout << R"(
@@ -34,24 +48,73 @@ void print_help() {
 Usage:
   pingu --test <test.json> [options]
   pingu --test_suit <suite.json> [options]
-  pingu --ping <url> [--ping-timeout <ms>] [--ping-retries <n>]
+  pingu --ping <url> [--ping <url>...] [--ping-timeout <ms>] [--ping-retries <n>]
+  pingu --ping <url> [--ping <url>...] --interval <ms> [--count <n>]
+  pingu --load <json_file> --rate <rps> --duration <s>
+  pingu --compile <suite.json> -o <suite.pingu>
+  pingu --compare <baseline.json> <current.json> [--threshold <pct>]
 
 Options:
   --test <json_file>         Run a single test case from test spec file.
-  --test_suit <json_file>    Run a full test suite with multiple cases.
+  --test_suit <json_file>    Run a full test suite with multiple cases (or a compiled bundle).
   --compact                  Print diff output in compact style.
   --parallel                 Run all tests in parallel (use with --test_suit).
+  --jobs <n>                 Worker threads for --parallel (default: hardware concurrency).
+  --async                    Drive all requests from one event loop (use with --test_suit).
+  --max-inflight <n>         Concurrent requests in --async mode (default: 1000).
+  --host-concurrency <n>     Cases in flight at once per host (default: unlimited).
+  --host-rate <rps>          Cases started per second per host (default: unlimited).
   --verbosity <level>        Verbosity level (0 = minimal, 1 = default, 2 = detailed).
-  --export-log <json_file>   Export test results and logs to JSON file.
-  --ping <url>               Perform a quick ping test on an endpoint.
-  --ping-timeout <ms>        Timeout for ping (default: 5000 ms).
-  --ping-retries <n>         Retry count for ping (default: 1).
+  --stream                   Validate responses while they download instead of parsing them whole.
+  --fail-fast                Stop a suite at its first failure: cancel requests in flight, skip the rest.
+                             With --stream, also abort a transfer at its first difference.
+  --deadline <s>             Time limit for the whole suite; requests still running are cancelled.
+  --watch                    Keep running and re-run the suite cases whose files change, plus failed ones.
+  --export-log <file>        Stream test results and logs to a JSON file (.jsonl: one result per line).
+  --history <file>           Run suite cases longest-first, using timings from a previous --export-log.
+  --shard <i/N>              Run only shard i of N of the suite (balanced by runtime with --history).
+  --merge-logs <out> <in>... Combine per-shard export logs into one report.
+  --compare <base> <current> Flag tests whose latency got significantly worse between two export logs.
+  --threshold <pct>          Smallest median slowdown --compare flags (default: 10).
+  --record <cassette>        Record every request and raw response of the run into a cassette file.
+  --serve <cassette>         Replay a cassette from a local mock HTTP server.
+  --port <n>                 Port for --serve, 0 for any free one (default: 8080).
+  --latency <ms>             Delay added to every --serve response (default: 0).
+  --base-url <url>           Send every request to this scheme://host:port, keeping its path and query.
+  --trace <file>             Write a Chrome/Perfetto trace of where Pingu spends its time.
+  --ping <url>               Perform a quick ping test on an endpoint (repeat for several targets).
+  --ping-timeout <ms>        Timeout for each ping attempt (default: 5000 ms).
+  --ping-retries <n>         Attempts for a single ping (default: 1).
+  --interval <ms>            Ping continuously, this far apart; also the delay between retries (default: 1000).
+  --count <n>                Ping continuously, n probes per target (default with --interval: until Ctrl-C).
+  --load <json_file>         Replay a test spec or suite at a fixed request rate.
+  --rate <rps>               Target request rate for --load (default: 10).
+  --duration <s>             Length of the --load run in seconds (default: 10).
+  --compile <json_file>      Bundle a suite and all its fixtures into one binary file.
+  -o <file>                  Output path for --compile (default: <suite>.pingu).
   --help                     Show this help message.
 
 Examples:
   pingu --test test.json --compact
   pingu --test_suit suite.json --parallel --export-log results.json
+  pingu --test_suit suite.json --parallel --jobs 16
+  pingu --test_suit suite.json --parallel --history results.json
+  pingu --test_suit suite.json --shard 2/4 --history results.json --export-log shard2.jsonl
+  pingu --merge-logs results.json shard1.jsonl shard2.jsonl shard3.jsonl shard4.jsonl
+  pingu --compare baseline.json results.json --threshold 20
+  pingu --test_suit suite.json --async --max-inflight 500
+  pingu --test_suit suite.json --parallel --jobs 32 --host-concurrency 4 --host-rate 20
+  pingu --test export_test.json --stream --fail-fast
+  pingu --test_suit suite.json --parallel --fail-fast --deadline 120
+  pingu --test_suit suite.json --parallel --watch
   pingu --ping https://httpbin.org/get --ping-retries 3
+  pingu --ping https://a.example.com --ping https://b.example.com --interval 500 --count 20
+  pingu --load suite.json --rate 200 --duration 60
+  pingu --test_suit suite.json --record suite.cassette
+  pingu --serve suite.cassette --port 9000 --latency 5
+  pingu --test_suit suite.json --base-url http://127.0.0.1:9000
+  pingu --test_suit suite.json --parallel --trace trace.json
+  pingu --compile suite.json -o suite.pingu && pingu --test_suit suite.pingu
 )";
 }
 
@@ -60,56 +123,172 @@ int main(int argc, char* argv[]) {
     bool isTestSuite = false;
     int verbosity = 1;
     bool runInParallel = false;
+    unsigned jobs = 0;
+    bool runAsync = false;
+    size_t maxInFlight = 1000;
+    bool streamBodies = false;
+    bool failFast = false;
+    double deadlineSec = 0;
+    bool watchFiles = false;
 
     std::string testSpecPath;
     std::string exportPath;
-    std::string pingUrl;
-    int pingTimeoutMs = 5000;
-    int pingRetries = 1;
+    std::string historyPath;
+    size_t shardIndex = 0, shardCount = 0;
+    std::string mergeOutPath;
+    std::string recordPath;
+    std::string servePath;
+    std::string baseUrl;
+    std::string tracePath;
+    mock_server::ServeOptions serveOptions;
+    std::vector<std::string> mergeInputs;
+    std::string compareBaseline, compareCurrent;
+    perf_compare::CompareOptions compareOptions;
+    std::vector<std::string> pingUrls;
+    ping_runner::PingOptions pingOptions;
+    std::string loadSpecPath;
+    load_runner::LoadOptions loadOptions;
+    bool maxInFlightSet = false;
+    size_t hostConcurrency = 0;
+    double hostRate = 0;
+    std::string compilePath;
+    std::string compileOutPath;
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--test") testSpecPath = argv[++i];
         else if (arg == "--test_suit") { isTestSuite = true; testSpecPath = argv[++i]; }
         else if (arg == "--parallel") runInParallel = true;
+        else if (arg == "--jobs" && i + 1 < argc) jobs = static_cast<unsigned>(std::stoul(argv[++i]));
+        else if (arg == "--async") runAsync = true;
+        else if (arg == "--max-inflight" && i + 1 < argc) { maxInFlight = std::stoul(argv[++i]); maxInFlightSet = true; }
+        else if (arg == "--host-concurrency" && i + 1 < argc) hostConcurrency = std::stoul(argv[++i]);
+        else if (arg == "--host-rate" && i + 1 < argc) hostRate = std::stod(argv[++i]);
         else if (arg == "--compact") printCompact = true;
         else if (arg == "--verbosity" && i + 1 < argc) verbosity = std::stoi(argv[++i]);
+        else if (arg == "--stream") streamBodies = true;
+        else if (arg == "--fail-fast") failFast = true;
+        else if (arg == "--deadline" && i + 1 < argc) deadlineSec = std::stod(argv[++i]);
+        else if (arg == "--watch") watchFiles = true;
         else if (arg == "--export-log" && i + 1 < argc) exportPath = argv[++i];
+        else if (arg == "--history" && i + 1 < argc) historyPath = argv[++i];
+        else if (arg == "--shard" && i + 1 < argc) {
+            if (!schedule::parse_shard(argv[++i], shardIndex, shardCount)) {
+                std::cerr << "Invalid --shard " << argv[i] << ": expected i/N with 1 <= i <= N\n";
+                return 1;
+            }
+        }
+        else if (arg == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (arg == "--serve" && i + 1 < argc) servePath = argv[++i];
+        else if (arg == "--base-url" && i + 1 < argc) baseUrl = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc) tracePath = argv[++i];
+        else if (arg == "--port" && i + 1 < argc) serveOptions.port = std::stoi(argv[++i]);
+        else if (arg == "--latency" && i + 1 < argc) serveOptions.latency_ms = std::stoi(argv[++i]);
+        else if (arg == "--merge-logs" && i + 2 < argc) {
+            mergeOutPath = argv[++i];
+            while (i + 1 < argc) mergeInputs.push_back(argv[++i]);
+        }
+        else if (arg == "--compare" && i + 2 < argc) { compareBaseline = argv[++i]; compareCurrent = argv[++i]; }
+        else if (arg == "--threshold" && i + 1 < argc) compareOptions.threshold_percent = std::stod(argv[++i]);
         else if (arg == "--help") { print_help(); return 0; }
-        else if (arg == "--ping" && i + 1 < argc) { pingUrl = argv[++i]; break; }
-        else if (arg == "--ping-timeout" && i + 1 < argc) pingTimeoutMs = std::stoi(argv[++i]);
-        else if (arg == "--ping-retries" && i + 1 < argc) pingRetries = std::stoi(argv[++i]);
+        else if (arg == "--ping" && i + 1 < argc) pingUrls.push_back(argv[++i]);
+        else if (arg == "--ping-timeout" && i + 1 < argc) pingOptions.timeout_ms = std::stoi(argv[++i]);
+        else if (arg == "--ping-retries" && i + 1 < argc) pingOptions.retries = std::stoi(argv[++i]);
+        else if (arg == "--interval" && i + 1 < argc) { pingOptions.interval_ms = std::stoi(argv[++i]); pingOptions.continuous = true; }
+        else if (arg == "--count" && i + 1 < argc) { pingOptions.count = std::stoi(argv[++i]); pingOptions.continuous = true; }
+        else if (arg == "--load" && i + 1 < argc) loadSpecPath = argv[++i];
+        else if (arg == "--rate" && i + 1 < argc) loadOptions.rate_per_sec = std::stod(argv[++i]);
+        else if (arg == "--duration" && i + 1 < argc) loadOptions.duration_sec = std::stod(argv[++i]);
+        else if (arg == "--compile" && i + 1 < argc) compilePath = argv[++i];
+        else if (arg == "-o" && i + 1 < argc) compileOutPath = argv[++i];
     }
 
-    if (!pingUrl.empty()) {
-        bool success = false;
+    if (!pingUrls.empty()) {
+        std::vector<ping_runner::TargetReport> reports;
+        bool answered = ping_runner::run_ping(pingUrls, pingOptions, reports);
+        if (pingOptions.continuous) ping_runner::print_report(reports, std::cout);
 
-        for (int attempt = 1; attempt <= pingRetries; ++attempt) {
-            std::cout << "Pinging " << pingUrl << " (attempt " << attempt << " of " << pingRetries << ")...\n";
+        if (!exportPath.empty()) {
+            nlohmann::json exportJson;
+            exportJson["ping"] = ping_runner::report_to_json(reports);
 
-            nlohmann::json response;
-            nlohmann::json dummyRequest = {
-                {"method", "GET"},
-                {"url", pingUrl},
-                {"timeout", pingTimeoutMs}
-            };
+            std::ofstream outFile(exportPath);
+            if (outFile.is_open()) {
+                outFile << exportJson.dump(2);
+                std::cout << "\nExported logs to " << exportPath << "\n";
+            } else {
+                std::cerr << "Failed to write logs to " << exportPath << "\n";
+            }
+        }
+        return answered ? 0 : 1;
+    }
+
+    if (!servePath.empty()) {
+        return mock_server::serve(servePath, serveOptions) ? 0 : 1;
+    }
+
+    if (!mergeOutPath.empty()) {
+        return result_sink::merge_exports(mergeInputs, mergeOutPath) ? 0 : 1;
+    }
+
+    if (!compareBaseline.empty()) {
+        perf_compare::CompareSummary summary;
+        if (!perf_compare::compare(compareBaseline, compareCurrent, compareOptions, std::cout, summary)) return 1;
+        return summary.slower > 0 ? 1 : 0;
+    }
 
-            auto start = std::chrono::high_resolution_clock::now();
-            success = http_utils::make_request_from_json(dummyRequest, response);
-            auto end = std::chrono::high_resolution_clock::now();
+    if (!compilePath.empty()) {
+        if (compileOutPath.empty()) {
+            compileOutPath = compilePath;
+            size_t dot = compileOutPath.rfind('.');
+            if (dot != std::string::npos && compileOutPath.find('/', dot) == std::string::npos)
+                compileOutPath.resize(dot);
+            compileOutPath += ".pingu";
+        }
+        return suite_bundle::compile(compilePath, compileOutPath) ? 0 : 1;
+    }
+
+    if (!baseUrl.empty()) http_utils::set_base_url(baseUrl);
+    if (!tracePath.empty()) trace::start();
+    // Written on every way out of main, failed runs included. Declared before everything that owns threads, so
+    // every pool and the engine are gone by the time it writes
+    struct TraceWriter {
+        const std::string& path;
+        ~TraceWriter() {
+            if (!path.empty()) trace::write(path);
+        }
+    } traceWriter{tracePath};
+
+    if (!loadSpecPath.empty()) {
+        nlohmann::json loadSpec;
+        if (!json_utils::read_json(loadSpecPath, loadSpec)) {
+            std::cerr << "Failed to read JSON from " << loadSpecPath << "\n";
+            return 1;
+        }
 
-            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        // Open-loop: do not cap in-flight requests unless asked to
+        loadOptions.max_in_flight = maxInFlightSet ? maxInFlight : 0;
 
-            if (success) {
-                std::cout << "Response received in " << ms << " ms\n";
-                return 0;
+        std::cout << "Load test: " << loadOptions.rate_per_sec << " req/s for "
+                  << loadOptions.duration_sec << " s\n";
+
+        load_runner::LoadReport report;
+        if (!load_runner::run_load(loadSpec, loadOptions, report)) return 1;
+        load_runner::print_report(report, std::cout);
+
+        if (!exportPath.empty()) {
+            nlohmann::json exportJson;
+            exportJson["load"] = load_runner::report_to_json(report);
+
+            std::ofstream outFile(exportPath);
+            if (outFile.is_open()) {
+                outFile << exportJson.dump(2);
+                std::cout << "\nExported logs to " << exportPath << "\n";
             } else {
-                std::cerr << "No response. Retrying...\n";
+                std::cerr << "Failed to write logs to " << exportPath << "\n";
             }
         }
-
-        std::cerr << "Failed to ping " << pingUrl << " after " << pingRetries << " attempts.\n";
-        return 1;
+        return report.errors ? 1 : 0;
     }
 
     if (testSpecPath.empty()) {
@@ -117,104 +296,476 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    cassette::Recorder recorder;
+    if (!recordPath.empty()) {
+        if (!recorder.open(recordPath)) return 1;
+        http_utils::set_recorder(&recorder);
+    }
+
+    fixture_cache::FixtureCache fixtures;
+    test_runner::RunOptions runOptions;
+    runOptions.fixtures = &fixtures;
+    runOptions.print_compact = printCompact;
+    runOptions.verbosity = verbosity;
+    runOptions.stream = streamBodies;
+    runOptions.fail_fast = failFast;
+
+    if (watchFiles && (!isTestSuite || suite_bundle::is_bundle(testSpecPath))) {
+        std::cerr << "--watch needs a suite file (--test_suit <suite.json>), not a single test or a bundle\n";
+        return 1;
+    }
+
     nlohmann::json testSpec;
-    if (!json_utils::read_json(testSpecPath, testSpec)) {
+    if (isTestSuite && suite_bundle::is_bundle(testSpecPath)) {
+        // Only the index is decoded here; fixtures are decoded on first use
+        auto bundle = suite_bundle::Bundle::open(testSpecPath);
+        if (!bundle) return 1;
+        testSpec = bundle->suite();
+        fixtures.set_bundle(std::move(bundle));
+    } else if (!json_utils::read_json(testSpecPath, testSpec)) {
         std::cerr << "Failed to read JSON from " << testSpecPath << "\n";
         return 1;
     }
 
     if (isTestSuite) {
-        if (!testSpec.contains("test_cases") || !testSpec["test_cases"].is_array()) {
-            std::cerr << "Invalid test suite: missing or invalid 'test_cases' array\n";
-            return 1;
-        }
+        // Kept across --watch runs, so their threads keep their connections open
+        std::unique_ptr<thread_pool::ThreadPool> pool;
+        std::unique_ptr<http_engine::Engine> engine;
+        // Suite cases that failed in the last run that included them
+        std::mutex failingMtx;
+        std::set<std::string> failing;
+
+        // Runs the `selected` cases of the suite (every case for nullptr); false when the suite is invalid
+        auto run_suite = [&](const std::vector<size_t>* selected) -> bool {
+            if (!testSpec.contains("test_cases") || !testSpec["test_cases"].is_array()) {
+                std::cerr << "Invalid test suite: missing or invalid 'test_cases' array\n";
+                return false;
+            }
 
-        if (verbosity > 0) {
-            std::cout << "Running Test Suite: " << testSpec["test_suit_name"] << "\n";
-            if (verbosity > 1 && !testSpec["test_suit_description"].empty()) {
-                std::cout << "Description: " << testSpec["test_suit_description"] << "\n";
+            if (verbosity > 0 && !selected) {
+                std::cout << "Running Test Suite: " << testSpec["test_suit_name"] << "\n";
+                if (verbosity > 1 && !testSpec["test_suit_description"].empty()) {
+                    std::cout << "Description: " << testSpec["test_suit_description"] << "\n";
+                }
             }
-        }
 
-        std::vector<TestResult> testLogs;
-        std::mutex log_mutex;
-        int passed = 0, failed = 0;
-
-        auto process_test = [&](const nlohmann::json& testCase) {
-            std::stringstream ss;
-            auto result = test_runner::run_test(testCase, printCompact, verbosity, ss);
-            std::lock_guard<std::mutex> lock(log_mutex);
-            testLogs.push_back({ testCase["test_name"], result.failed, result.api_time_ms, result.test_time_ms, std::move(ss) });
-            if (result.failed) failed++;
-            else passed++;
-        };
+            const nlohmann::json& testCases = testSpec["test_cases"];
 
-        if (runInParallel) {
-            std::vector<std::thread> threads;
-            for (const auto& testCase : testSpec["test_cases"]) {
-                threads.emplace_back(process_test, testCase);
+            // Nothing from an earlier run carries over: budgets are parsed afresh and the stop is lifted
+            http_utils::reset_cancel();
+            runOptions.budget = {};
+            std::string budgetError;
+            if (!test_runner::parse_budget(testSpec, runOptions.budget, budgetError)) {
+                std::cerr << "Invalid test suite: " << budgetError << "\n";
+                return false;
             }
-            for (auto& t : threads) if (t.joinable()) t.join();
-        } else {
-            for (const auto& testCase : testSpec["test_cases"]) {
-                process_test(testCase);
+
+            // The command line overrides the suite's defaults for every host
+            host_limits::Config hostConfig;
+            std::string hostError;
+            if (!host_limits::parse_config(testSpec, hostConfig, hostError)) {
+                std::cerr << "Invalid test suite: " << hostError << "\n";
+                return false;
+            }
+            if (hostConcurrency > 0) hostConfig.defaults.max_concurrency = hostConcurrency;
+            if (hostRate > 0) hostConfig.defaults.rate = hostRate;
+
+            schedule::History history;
+            if (!historyPath.empty() && !schedule::load_history(historyPath, history)) return false;
+            const schedule::History* timings = historyPath.empty() ? nullptr : &history;
+
+            std::vector<size_t> order;
+            if (shardCount > 0) {
+                order = schedule::shard(testCases, timings, shardIndex, shardCount);
+                if (verbosity > 0) {
+                    std::cout << "Shard " << shardIndex + 1 << "/" << shardCount << ": " << order.size() << " of "
+                              << testCases.size() << " cases" << (timings ? ", balanced by runtime" : "") << "\n";
+                }
+            } else {
+                for (size_t i = 0; i < testCases.size(); ++i) order.push_back(i);
+            }
+            if (selected) {
+                std::vector<bool> chosen(testCases.size(), false);
+                for (size_t index : *selected) chosen[index] = true;
+                order.erase(std::remove_if(order.begin(), order.end(), [&](size_t index) { return !chosen[index]; }),
+                            order.end());
+            }
+            {
+                // Cases run again lose their old verdict
+                std::lock_guard<std::mutex> lock(failingMtx);
+                for (size_t index : order) failing.erase(testCases[index].value("test_name", std::string()));
+            }
+            size_t caseCount = order.size();
+            // A case with "parameters" stands for one case per row of its table, counted as the rows are read
+            size_t tableCases = std::count_if(order.begin(), order.end(), [&](size_t index) {
+                return param_table::is_parameterized(testCases[index]);
+            });
+
+            // Cases that run side by side, used to predict the makespan
+            size_t slots = 1;
+            if (runAsync) {
+                if (jobs == 0) jobs = std::min(4u, thread_pool::ThreadPool::default_workers());
+                slots = maxInFlight == 0 ? caseCount : std::min(maxInFlight, caseCount); // 0: unlimited
+            } else if (runInParallel) {
+                if (jobs == 0) jobs = thread_pool::ThreadPool::default_workers();
+                if (tableCases == 0 && caseCount > 0 && jobs > caseCount) jobs = static_cast<unsigned>(caseCount);
+                slots = jobs;
             }
-        }
 
-        for (const auto& result : testLogs) {
-            std::cout << result.log.str();
-        }
+            schedule::Plan plan;
+            if (timings) {
+                plan = schedule::plan(testCases, order, history, slots);
+                order = plan.order;
+                if (verbosity > 0) {
+                    std::cout << "Scheduling longest-first: " << plan.known << " of " << caseCount
+                              << " cases have timings in " << historyPath << "\n";
+                }
+            }
 
-        std::cout << "\nPassed: " << passed << " | Failed: " << failed << "\n";
+            // Cases with "depends_on" start once their dependencies have passed
+            bool chained = test_graph::is_chained(testCases);
+            test_graph::Graph graph;
+            if (chained) {
+                std::string graphError;
+                if (!graph.build(testCases, order, graphError)) {
+                    std::cerr << "Invalid test suite: " << graphError << "\n";
+                    return false;
+                }
+            }
+            const std::vector<size_t> startOrder = chained ? graph.roots() : order;
+
+            // Rows are generated only as fast as cases finish, so a table of any length runs in constant memory
+            size_t window = runAsync ? (maxInFlight > 0 ? maxInFlight : 1000) : runInParallel ? size_t{jobs} * 2 : 1;
+            param_table::Expander expander(testCases, window);
+            std::vector<size_t> plainStart;
+            for (size_t index : startOrder) {
+                if (!param_table::is_parameterized(testCases[index])) {
+                    plainStart.push_back(index);
+                    continue;
+                }
+                std::string tableError;
+                if (!expander.add(index, tableError)) {
+                    std::cerr << "Invalid test suite: " << testCases[index]["test_name"] << ": " << tableError << "\n";
+                    return false;
+                }
+            }
+            auto case_spec = [&](size_t index) -> const nlohmann::json& {
+                return expander.generated(index) ? expander.spec(index) : testCases[index];
+            };
 
-        if (!exportPath.empty()) {
-            nlohmann::json exportJson;
-            exportJson["test_suite_name"] = testSpec["test_suit_name"];
-            exportJson["results"] = nlohmann::json::array();
+            result_sink::ResultSink sink(std::cout, caseCount - tableCases);
+            if (!exportPath.empty() && !sink.open_export(exportPath, testSpec["test_suit_name"])) return false;
+
+            // Hands a case that just became ready to the running mode
+            std::function<void(size_t)> start_case;
+
+            // Per-host limits hold cases back until their host has room; other hosts keep going meanwhile
+            std::unique_ptr<host_limits::HostScheduler> limiter;
+            std::vector<std::string> caseHosts;
+            if (!hostConfig.empty()) {
+                caseHosts.resize(testCases.size());
+                for (size_t index : order) {
+                    const auto& testCase = testCases[index];
+                    if (!testCase.contains("request_description") || !testCase["request_description"].is_string()) continue;
+                    auto request = fixtures.load(testCase["request_description"].get<std::string>());
+                    if (request && request->is_object() && request->contains("url") && (*request)["url"].is_string())
+                        caseHosts[index] = http_utils::host_of((*request)["url"].get<std::string>());
+                }
+                if (!runAsync && !runInParallel) {
+                    // One case at a time anyway; a single slot keeps handed-out cases from piling up in the ready queue
+                    hostConfig.defaults.max_concurrency = 1;
+                    for (auto& [host, limit] : hostConfig.hosts) limit.max_concurrency = 1;
+                }
+                limiter = std::make_unique<host_limits::HostScheduler>(
+                    std::move(hostConfig), [&start_case](size_t index) { start_case(index); });
+            }
+
+            // Generated cases go to the host of the case they came from
+            auto case_host = [&](size_t index) -> const std::string& {
+                return caseHosts[expander.generated(index) ? expander.parent(index) : index];
+            };
+
+            // A case with "repeat" takes a token per request
+            auto dispatch = [&](size_t index) {
+                if (!limiter) {
+                    start_case(index);
+                    return;
+                }
+                const auto& repeat = case_spec(index).value("repeat", nlohmann::json(1));
+                double cost = repeat.is_number_integer() && repeat.get<int>() > 1 ? repeat.get<double>() : 1.0;
+                limiter->submit(index, case_host(index), cost);
+            };
+
+            // --fail-fast and --deadline stop the run: transfers in flight are cancelled, cases not yet started are skipped
+            std::atomic<bool> failedFast{false};
+            std::atomic<size_t> notRun{0};
+            std::function<void()> cancel_inflight;
+            auto stop_reason = [&]() -> std::string {
+                return failedFast ? "an earlier case failed (--fail-fast)" : "the suite deadline passed (--deadline)";
+            };
+
+            // A failed row marks its whole parameterized case, which --watch runs again
+            auto remember_failure = [&](size_t index) {
+                if (!watchFiles) return;
+                size_t suiteIndex = expander.generated(index) ? expander.parent(index) : index;
+                std::lock_guard<std::mutex> lock(failingMtx);
+                failing.insert(testCases[suiteIndex].value("test_name", std::string()));
+            };
+
+            auto record_result = [&](size_t index, const test_runner::TestExecutionResult& result, std::stringstream& ss) {
+                sink.add(case_spec(index).value("test_name", std::string()), result, ss.str());
+                if (result.failed) remember_failure(index);
+                if (failFast && result.failed && !failedFast.exchange(true)) {
+                    http_utils::cancel();
+                    if (cancel_inflight) cancel_inflight();
+                }
+                if (chained && !expander.generated(index)) {
+                    test_graph::Release release = graph.finish(index, !result.failed, result.extracted);
+                    for (const auto& [skipped, dependency] : release.skipped) {
+                        std::stringstream log;
+                        auto skippedResult = test_runner::skip_test(
+                            testCases[skipped], "depends on \"" + dependency + "\", which did not pass", runOptions, log);
+                        sink.add(testCases[skipped].value("test_name", std::string()), skippedResult, log.str());
+                        remember_failure(skipped);
+                    }
+                    for (size_t next : release.ready) dispatch(next);
+                }
+                // Only after the released cases are queued, so the limiter never looks idle in between
+                if (limiter) limiter->done(case_host(index));
+                if (expander.generated(index)) expander.release(index);
+            };
+
+            // A chained case sees the variables its dependencies extracted, a generated one its row
+            auto options_for = [&](size_t index, nlohmann::json& variables) {
+                test_runner::RunOptions options = runOptions;
+                if (expander.generated(index)) {
+                    options.variables = &expander.row(index);
+                    options.source = &testCases[expander.parent(index)];
+                } else if (chained) {
+                    variables = graph.variables(index);
+                    options.variables = &variables;
+                }
+                return options;
+            };
+
+            auto skip_if_stopped = [&](size_t index) {
+                if (!http_utils::cancelled()) return false;
+                ++notRun;
+                std::stringstream log;
+                auto result = test_runner::skip_test(case_spec(index), stop_reason(), runOptions, log);
+                record_result(index, result, log);
+                return true;
+            };
 
-            for (const auto& result : testLogs) {
-                exportJson["results"].push_back({
-                    { "test_name", result.name },
-                    { "status", result.failed ? "failed" : "passed" },
-                    { "api_time_ms", result.api_time_ms },
-                    { "test_time_ms", result.test_time_ms },
-                    { "log", result.log.str() }
-                });
+            auto process_test = [&](size_t index) {
+                if (skip_if_stopped(index)) return;
+                nlohmann::json variables;
+                std::stringstream ss;
+                auto result = test_runner::run_test(case_spec(index), options_for(index, variables), ss);
+                record_result(index, result, ss);
+            };
+
+            // Reads the next row of a table and dispatches its case; false once the tables are used up
+            auto feed_one = [&]() {
+                size_t id;
+                std::string rowError;
+                if (http_utils::cancelled() || !expander.next(id, rowError)) return false;
+                sink.add_total(1);
+                if (rowError.empty()) {
+                    dispatch(id);
+                    return true;
+                }
+                std::stringstream log;
+                auto result = test_runner::skip_test(expander.spec(id), rowError, runOptions, log);
+                sink.add(expander.spec(id).value("test_name", std::string()), result, log.str());
+                remember_failure(id);
+                expander.release(id);
+                return true;
+            };
+
+            auto connectionsBefore = http_utils::connection_stats();
+            auto runStart = std::chrono::steady_clock::now();
+            if (deadlineSec > 0) {
+                http_utils::set_deadline(runStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                        std::chrono::duration<double>(deadlineSec)));
             }
 
-            std::ofstream outFile(exportPath);
-            if (outFile.is_open()) {
-                outFile << exportJson.dump(2);
-                std::cout << "\nExported logs to " << exportPath << "\n";
+            if (runAsync) {
+                // One event loop keeps the requests in flight; a small pool diffs the responses
+                if (!pool) pool = std::make_unique<thread_pool::ThreadPool>(jobs);
+                if (!engine) engine = std::make_unique<http_engine::Engine>(maxInFlight, pool.get());
+                if (!engine->ok()) {
+                    std::cerr << "Failed to start the async request engine\n";
+                    return false;
+                }
+                cancel_inflight = [&] { engine->cancel(); };
+                start_case = [&](size_t index) {
+                    if (skip_if_stopped(index)) return;
+                    nlohmann::json variables;
+                    test_runner::run_test_async(case_spec(index), options_for(index, variables), *engine,
+                        [&record_result, index](const test_runner::TestExecutionResult& result, std::stringstream& ss) {
+                            record_result(index, result, ss);
+                        });
+                };
+                for (size_t index : plainStart) dispatch(index);
+                while (feed_one()) {}
+                if (limiter) limiter->wait_idle();
+                engine->wait_idle();
+                pool->wait_idle();
+            } else if (runInParallel) {
+                // Bounded pool: thread count stays fixed however large the suite is
+                if (!pool) pool = std::make_unique<thread_pool::ThreadPool>(jobs);
+                start_case = [&](size_t index) {
+                    pool->submit([&process_test, index] { process_test(index); });
+                };
+                for (size_t index : plainStart) dispatch(index);
+                while (feed_one()) {}
+                if (limiter) limiter->wait_idle();
+                pool->wait_idle();
             } else {
-                std::cerr << "Failed to write logs to " << exportPath << "\n";
+                // Cases held back by a rate limit are released from the limiter's timer thread
+                std::mutex readyMtx;
+                std::condition_variable readyCv;
+                std::deque<size_t> ready;
+                start_case = [&](size_t index) {
+                    {
+                        std::lock_guard<std::mutex> lock(readyMtx);
+                        ready.push_back(index);
+                    }
+                    readyCv.notify_one();
+                };
+                for (size_t index : plainStart) dispatch(index);
+                while (true) {
+                    size_t index = 0;
+                    bool haveCase = false;
+                    {
+                        std::unique_lock<std::mutex> lock(readyMtx);
+                        readyCv.wait(lock, [&] { return !ready.empty() || !limiter || limiter->idle(); });
+                        if (!ready.empty()) {
+                            index = ready.front();
+                            ready.pop_front();
+                            haveCase = true;
+                        }
+                    }
+                    // Everything handed out has run; the next row of a table, if any, goes next
+                    if (haveCase) process_test(index);
+                    else if (!feed_one()) break;
+                }
             }
-        }
 
-    } else {
-        std::stringstream ss;
-        auto result = test_runner::run_test(testSpec, printCompact, verbosity, ss);
-        std::cout << ss.str();
-        std::cout << (result.failed ? "Test Failed\n" : "Test Passed\n");
+            auto makespanMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - runStart).count();
 
-        if (!exportPath.empty()) {
-            nlohmann::json exportJson;
-            exportJson["results"] = {{
-                { "test_name", testSpec["test_name"] },
-                { "status", result.failed ? "failed" : "passed" },
-                { "api_time_ms", result.api_time_ms },
-                { "test_time_ms", result.test_time_ms },
-                { "log", ss.str() }
-            }};
+            std::cout << "\nPassed: " << sink.passed() << " | Failed: " << sink.failed() << "\n";
+            if (failedFast || (deadlineSec > 0 && http_utils::cancelled()))
+                std::cout << "Stopped early, " << stop_reason() << ": " << notRun << " cases not run\n";
+            if (!historyPath.empty() && plan.known > 0) {
+                std::cout << "Makespan: predicted " << static_cast<long long>(plan.predicted_ms) << " ms | actual "
+                          << makespanMs << " ms\n";
+            }
 
-            std::ofstream outFile(exportPath);
-            if (outFile.is_open()) {
-                outFile << exportJson.dump(2);
-                std::cout << "\nExported logs to " << exportPath << "\n";
-            } else {
-                std::cerr << "Failed to write logs to " << exportPath << "\n";
+            // This run's share, as --watch runs one after another in the same process
+            auto connections = http_utils::connection_stats();
+            std::cout << "Connections: " << connections.reused - connectionsBefore.reused << " reused | "
+                      << connections.created - connectionsBefore.created << " new\n";
+
+            if (limiter && verbosity > 1) {
+                for (const auto& [host, stats] : limiter->stats()) {
+                    std::cout << "Host " << host << ": " << stats.started << " cases | max " << stats.max_in_flight
+                              << " in flight | " << static_cast<long long>(stats.throttled_ms) << " ms held back\n";
+                }
+            }
+
+            if (verbosity > 1) {
+                auto cache = fixtures.stats();
+                std::cout << "Fixtures: " << cache.lookups << " loads | " << cache.files_read << " files | "
+                          << cache.parsed << " parsed (" << cache.bytes_parsed / 1024 << " KiB)\n";
+            }
+
+            sink.finish();
+            return true;
+        };
+
+        if (!run_suite(nullptr) && !watchFiles) return 1;
+
+        // Runs until Ctrl-C, then ends like any other run; cached fixtures and open connections carry over
+        if (watchFiles) {
+            file_watch::Watcher watcher;
+            if (!watcher.ok()) return 1;
+            const std::string suitePath = file_watch::absolute(testSpecPath);
+            while (!watcher.interrupted()) {
+                watcher.add(testSpecPath);
+                if (testSpec.contains("test_cases") && testSpec["test_cases"].is_array()) {
+                    for (const auto& testCase : testSpec["test_cases"])
+                        for (const auto& file : file_watch::case_files(testCase)) watcher.add(file);
+                }
+                if (verbosity > 0) std::cout << "\nWatching " << watcher.directories() << " directories for changes (Ctrl-C to stop)\n";
+
+                std::set<std::string> changed = watcher.wait();
+                if (watcher.interrupted()) break;
+                // Events were lost, so any file may have changed: start over with the whole suite
+                bool everything = watcher.missed_changes();
+                if (everything) fixtures.clear();
+                for (const auto& path : changed) fixtures.invalidate(path);
+
+                std::vector<size_t> affected;
+                if (everything || changed.count(suitePath)) {
+                    nlohmann::json updated;
+                    if (!json_utils::read_json(testSpecPath, updated) || !updated.is_object() ||
+                        !updated.contains("test_cases") || !updated["test_cases"].is_array()) {
+                        std::cerr << "Invalid test suite " << testSpecPath << ", waiting for the next change\n";
+                        continue;
+                    }
+                    affected = file_watch::changed_cases(testSpec, updated);
+                    testSpec = std::move(updated);
+                }
+                const nlohmann::json& testCases = testSpec["test_cases"];
+                for (size_t index : file_watch::cases_using(testCases, changed)) affected.push_back(index);
+                if (everything) {
+                    std::cout << "\nSome file changes were missed, re-running every case\n";
+                    affected.resize(testCases.size());
+                    for (size_t i = 0; i < testCases.size(); ++i) affected[i] = i;
+                }
+                if (affected.empty()) continue;
+
+                // The cases that failed last time go along, in case the change fixed them
+                std::vector<size_t> selected;
+                {
+                    std::vector<bool> chosen(testCases.size(), false);
+                    for (size_t index : affected) chosen[index] = true;
+                    std::lock_guard<std::mutex> lock(failingMtx);
+                    for (size_t i = 0; i < testCases.size(); ++i) {
+                        if (chosen[i] || failing.count(testCases[i].value("test_name", std::string())))
+                            selected.push_back(i);
+                    }
+                }
+                // A chained case needs its dependencies for their variables, and its dependents see its new result
+                if (test_graph::is_chained(testCases)) selected = test_graph::related(testCases, selected);
+
+                std::cout << "\nChange detected: re-running " << selected.size() << " of " << testCases.size()
+                          << " cases\n";
+                run_suite(&selected);
             }
         }
+    } else {
+        result_sink::ResultSink sink(std::cout, 1);
+        if (!exportPath.empty() && !sink.open_export(exportPath, nullptr)) return 1;
+
+        if (param_table::is_parameterized(testSpec)) {
+            std::cerr << "'parameters' is only supported for the cases of a test suite (--test_suit)\n";
+            return 1;
+        }
+
+        std::stringstream ss;
+        auto result = test_runner::run_test(testSpec, runOptions, ss);
+        sink.add(testSpec.value("test_name", std::string()), result, ss.str());
+        std::cout << (result.failed ? "Test Failed\n" : "Test Passed\n");
+        sink.finish();
+    }
+
+    if (!recordPath.empty()) {
+        http_utils::set_recorder(nullptr);
+        std::cout << "Recorded " << recorder.count() << " responses to " << recordPath << "\n";
     }
 
     return 0;
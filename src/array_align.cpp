@@ -0,0 +1,255 @@
+#include "array_align.hpp"
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+
+namespace array_align {
+
+namespace {
+
+// Diagonal steps spent in bisection before an alignment gives up and
+// treats the remaining range as replaced.
+constexpr long kWorkBudget = 20000000;
+
+using array_t = nlohmann::json::array_t;
+
+void hash_combine(size_t &seed, size_t value) {
+  seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+// Agrees with json's operator==, which std::hash<json> does not: 1, 1u and
+// 1.0 compare equal but hash differently there.
+size_t value_hash(const nlohmann::json &value) {
+  size_t seed = static_cast<size_t>(value.type());
+  switch (value.type()) {
+  case nlohmann::json::value_t::object:
+    for (auto it = value.begin(); it != value.end(); ++it) {
+      hash_combine(seed, std::hash<std::string>{}(it.key()));
+      hash_combine(seed, value_hash(it.value()));
+    }
+    return seed;
+  case nlohmann::json::value_t::array:
+    for (const auto &element : value)
+      hash_combine(seed, value_hash(element));
+    return seed;
+  case nlohmann::json::value_t::string:
+    return std::hash<std::string>{}(value.get_ref<const std::string &>());
+  case nlohmann::json::value_t::boolean:
+    return std::hash<bool>{}(value.get<bool>());
+  case nlohmann::json::value_t::number_integer:
+  case nlohmann::json::value_t::number_unsigned:
+  case nlohmann::json::value_t::number_float:
+    return std::hash<double>{}(value.get<double>()) ^ 0x5bd1e995;
+  default:
+    return seed;
+  }
+}
+
+struct Aligner {
+  const array_t &a;
+  const array_t &b;
+  std::vector<size_t> ha, hb; // element hashes, filled for bisected ranges
+  std::vector<std::pair<size_t, size_t>> matches;
+  long budget = kWorkBudget;
+
+  Aligner(const array_t &a, const array_t &b)
+      : a(a), b(b), ha(a.size()), hb(b.size()) {}
+
+  bool eq(size_t i, size_t j) const { return ha[i] == hb[j] && a[i] == b[j]; }
+
+  void diff(size_t a0, size_t a1, size_t b0, size_t b1) {
+    while (a0 < a1 && b0 < b1 && a[a0] == b[b0])
+      matches.emplace_back(a0++, b0++);
+
+    size_t suffix = 0;
+    while (a1 > a0 && b1 > b0 && a[a1 - 1] == b[b1 - 1]) {
+      --a1;
+      --b1;
+      ++suffix;
+    }
+
+    if (a0 < a1 && b0 < b1) {
+      for (size_t i = a0; i < a1; ++i)
+        ha[i] = value_hash(a[i]);
+      for (size_t j = b0; j < b1; ++j)
+        hb[j] = value_hash(b[j]);
+
+      size_t x, y;
+      if (bisect(a0, a1, b0, b1, x, y)) {
+        diff(a0, x, b0, y);
+        diff(x, a1, y, b1);
+      }
+    }
+
+    for (size_t k = 0; k < suffix; ++k)
+      matches.emplace_back(a1 + k, b1 + k);
+  }
+
+  // Finds the middle of a shortest edit script between a[a0,a1) and
+  // b[b0,b1) by running the search from both ends until the paths overlap.
+  // Memory is O(n + m). Returns false when the ranges share nothing (or the
+  // work budget ran out).
+  bool bisect(size_t a0, size_t a1, size_t b0, size_t b1, size_t &split_x,
+              size_t &split_y) {
+    const long n = static_cast<long>(a1 - a0);
+    const long m = static_cast<long>(b1 - b0);
+    const long max_d = (n + m + 1) / 2;
+    const long v_offset = max_d;
+    const long v_length = 2 * max_d + 2;
+    std::vector<long> v1(v_length, -1), v2(v_length, -1);
+    v1[v_offset + 1] = 0;
+    v2[v_offset + 1] = 0;
+
+    const long delta = n - m;
+    const bool front = (delta % 2 != 0);
+    long k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+    for (long d = 0; d < max_d; ++d) {
+      if (budget <= 0)
+        return false;
+
+      for (long k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+        const long k1_offset = v_offset + k1;
+        long x1;
+        if (k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1]))
+          x1 = v1[k1_offset + 1];
+        else
+          x1 = v1[k1_offset - 1] + 1;
+        long y1 = x1 - k1;
+        while (x1 < n && y1 < m && eq(a0 + x1, b0 + y1)) {
+          ++x1;
+          ++y1;
+        }
+        --budget;
+        v1[k1_offset] = x1;
+        if (x1 > n) {
+          k1end += 2;
+        } else if (y1 > m) {
+          k1start += 2;
+        } else if (front) {
+          const long k2_offset = v_offset + delta - k1;
+          if (k2_offset >= 0 && k2_offset < v_length && v2[k2_offset] != -1) {
+            const long x2 = n - v2[k2_offset];
+            if (x1 >= x2) {
+              split_x = a0 + x1;
+              split_y = b0 + y1;
+              return true;
+            }
+          }
+        }
+      }
+
+      for (long k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+        const long k2_offset = v_offset + k2;
+        long x2;
+        if (k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1]))
+          x2 = v2[k2_offset + 1];
+        else
+          x2 = v2[k2_offset - 1] + 1;
+        long y2 = x2 - k2;
+        while (x2 < n && y2 < m && eq(a0 + n - x2 - 1, b0 + m - y2 - 1)) {
+          ++x2;
+          ++y2;
+        }
+        --budget;
+        v2[k2_offset] = x2;
+        if (x2 > n) {
+          k2end += 2;
+        } else if (y2 > m) {
+          k2start += 2;
+        } else if (!front) {
+          const long k1_offset = v_offset + delta - k2;
+          if (k1_offset >= 0 && k1_offset < v_length && v1[k1_offset] != -1) {
+            const long x1 = v1[k1_offset];
+            const long y1 = v_offset + x1 - k1_offset;
+            if (x1 >= n - x2) {
+              split_x = a0 + x1;
+              split_y = b0 + y1;
+              return true;
+            }
+          }
+        }
+      }
+    }
+    return false;
+  }
+};
+
+} // namespace
+
+std::vector<ElementPair> align_ordered(const nlohmann::json &expected,
+                                       const nlohmann::json &actual,
+                                       size_t offset) {
+  const array_t &a = expected.get_ref<const array_t &>();
+  const array_t &b = actual.get_ref<const array_t &>();
+  offset = std::min(offset, a.size());
+
+  Aligner aligner(a, b);
+  aligner.diff(offset, a.size(), 0, b.size());
+
+  std::vector<ElementPair> pairs;
+  pairs.reserve(std::max(a.size() - offset, b.size()));
+  size_t i = offset, j = 0;
+
+  // Deleted a[i, ie) and inserted b[j, je) between two matches: pair them
+  // up by position, the surplus on either side is removed / added.
+  auto flush = [&](size_t ie, size_t je) {
+    size_t deleted = ie - i, inserted = je - j;
+    size_t paired = std::min(deleted, inserted);
+    for (size_t k = 0; k < paired; ++k)
+      pairs.push_back({&a[i + k], &b[j + k], offset + j + k, false});
+    for (size_t k = paired; k < deleted; ++k)
+      pairs.push_back({&a[i + k], nullptr, i + k, false});
+    for (size_t k = paired; k < inserted; ++k)
+      pairs.push_back({nullptr, &b[j + k], offset + j + k, false});
+  };
+
+  for (const auto &[mi, mj] : aligner.matches) {
+    flush(mi, mj);
+    pairs.push_back({&a[mi], &b[mj], offset + mj, true});
+    i = mi + 1;
+    j = mj + 1;
+  }
+  flush(a.size(), b.size());
+  return pairs;
+}
+
+bool align_keyed(const nlohmann::json &expected, const nlohmann::json &actual,
+                 const std::string &field, std::vector<ElementPair> &out) {
+  auto keyed = [&field](const nlohmann::json &arr) {
+    return std::all_of(arr.begin(), arr.end(), [&field](const auto &el) {
+      return el.is_object() && el.contains(field);
+    });
+  };
+  if (!keyed(expected) || !keyed(actual))
+    return false;
+
+  std::unordered_multimap<size_t, size_t> byKey;
+  byKey.reserve(expected.size());
+  for (size_t i = 0; i < expected.size(); ++i)
+    byKey.emplace(value_hash(expected[i][field]), i);
+
+  std::vector<bool> used(expected.size(), false);
+  for (size_t j = 0; j < actual.size(); ++j) {
+    const auto &key = actual[j][field];
+    const nlohmann::json *partner = nullptr;
+    auto range = byKey.equal_range(value_hash(key));
+    for (auto it = range.first; it != range.second; ++it) {
+      if (!used[it->second] && expected[it->second][field] == key) {
+        used[it->second] = true;
+        partner = &expected[it->second];
+        break;
+      }
+    }
+    out.push_back({partner, &actual[j], j, false});
+  }
+  size_t missing = actual.size();
+  for (size_t i = 0; i < expected.size(); ++i) {
+    if (!used[i])
+      out.push_back({&expected[i], nullptr, missing++, false});
+  }
+  return true;
+}
+
+} // namespace array_align
@@ -0,0 +1,212 @@
+#include "cassette.hpp"
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace cassette {
+
+namespace {
+
+// Well-formed UTF-8 as RFC 3629 defines it: no overlong forms, no
+// surrogates, nothing above U+10FFFF.
+bool is_utf8(const std::string &text) {
+  const auto *s = reinterpret_cast<const unsigned char *>(text.data());
+  size_t n = text.size();
+  for (size_t i = 0; i < n;) {
+    unsigned char c = s[i];
+    size_t len;
+    unsigned char lo = 0x80, hi = 0xBF; // allowed range of the 2nd byte
+    if (c < 0x80) {
+      ++i;
+      continue;
+    } else if (c >= 0xC2 && c <= 0xDF) {
+      len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+      len = 3;
+      if (c == 0xE0)
+        lo = 0xA0;
+      else if (c == 0xED)
+        hi = 0x9F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+      len = 4;
+      if (c == 0xF0)
+        lo = 0x90;
+      else if (c == 0xF4)
+        hi = 0x8F;
+    } else {
+      return false;
+    }
+    if (i + len > n || s[i + 1] < lo || s[i + 1] > hi)
+      return false;
+    for (size_t k = 2; k < len; ++k)
+      if (s[i + k] < 0x80 || s[i + k] > 0xBF)
+        return false;
+    i += len;
+  }
+  return true;
+}
+
+const char kBase64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+std::string base64_encode(const std::string &bytes) {
+  std::string out;
+  out.reserve((bytes.size() + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 2 < bytes.size(); i += 3) {
+    uint32_t v = static_cast<unsigned char>(bytes[i]) << 16 |
+                 static_cast<unsigned char>(bytes[i + 1]) << 8 |
+                 static_cast<unsigned char>(bytes[i + 2]);
+    for (int shift = 18; shift >= 0; shift -= 6)
+      out += kBase64[(v >> shift) & 0x3F];
+  }
+  if (i < bytes.size()) {
+    uint32_t v = static_cast<unsigned char>(bytes[i]) << 16;
+    if (i + 1 < bytes.size())
+      v |= static_cast<unsigned char>(bytes[i + 1]) << 8;
+    out += kBase64[(v >> 18) & 0x3F];
+    out += kBase64[(v >> 12) & 0x3F];
+    out += i + 1 < bytes.size() ? kBase64[(v >> 6) & 0x3F] : '=';
+    out += '=';
+  }
+  return out;
+}
+
+// Throws std::invalid_argument on anything but padded standard base64.
+std::string base64_decode(const std::string &text) {
+  if (text.size() % 4 != 0)
+    throw std::invalid_argument("base64 length is not a multiple of 4");
+  std::string out;
+  out.reserve(text.size() / 4 * 3);
+  for (size_t i = 0; i < text.size(); i += 4) {
+    uint32_t v = 0;
+    int pad = 0;
+    for (size_t k = 0; k < 4; ++k) {
+      char c = text[i + k];
+      const char *pos = c ? std::strchr(kBase64, c) : nullptr;
+      if (c == '=' && i + 4 == text.size() && k >= 2) {
+        ++pad;
+      } else if (!pos || pad > 0) {
+        throw std::invalid_argument("invalid base64");
+      }
+      v = v << 6 | (pos ? static_cast<uint32_t>(pos - kBase64) : 0);
+    }
+    out += static_cast<char>(v >> 16);
+    if (pad < 2)
+      out += static_cast<char>(v >> 8 & 0xFF);
+    if (pad < 1)
+      out += static_cast<char>(v & 0xFF);
+  }
+  return out;
+}
+
+// Stores a body as text, or as base64 with "<field>_encoding" set when it is
+// not UTF-8, so binary bodies replay byte for byte.
+void put_body(nlohmann::json &line, const char *field,
+              const std::string &body) {
+  if (is_utf8(body)) {
+    line[field] = body;
+    return;
+  }
+  line[field] = base64_encode(body);
+  line[std::string(field) + "_encoding"] = "base64";
+}
+
+std::string get_body(const nlohmann::json &record, const char *field) {
+  std::string body = record.value(field, "");
+  std::string encoding = record.value(std::string(field) + "_encoding", "");
+  if (encoding.empty())
+    return body;
+  if (encoding != "base64")
+    throw std::invalid_argument("unknown " + std::string(field) +
+                                "_encoding \"" + encoding + "\"");
+  return base64_decode(body);
+}
+
+} // namespace
+
+std::string target_of(const std::string &url) {
+  size_t scheme = url.find("://");
+  size_t start = scheme == std::string::npos ? 0 : scheme + 3;
+  size_t path = url.find_first_of("/?", start);
+  if (path == std::string::npos)
+    return "/";
+  std::string target = url.substr(path, url.find('#', path) - path);
+  if (target[0] == '?')
+    target.insert(0, "/");
+  return target;
+}
+
+bool Recorder::open(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mtx);
+  out.open(path);
+  if (!out.is_open()) {
+    std::cerr << "Failed to write " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+void Recorder::record(const Interaction &interaction) {
+  nlohmann::json headers = nlohmann::json::array();
+  for (const auto &[name, value] : interaction.headers)
+    headers.push_back({name, value});
+
+  nlohmann::json line = {{"method", interaction.method},
+                         {"target", interaction.target},
+                         {"status", interaction.status},
+                         {"headers", std::move(headers)}};
+  put_body(line, "request_body", interaction.request_body);
+  put_body(line, "body", interaction.body);
+  // Header values that are not UTF-8 are stored with replacement characters
+  std::string text =
+      line.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+
+  std::lock_guard<std::mutex> lock(mtx);
+  out << text << "\n";
+  out.flush();
+  ++written;
+}
+
+size_t Recorder::count() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return written;
+}
+
+bool load(const std::string &path, std::vector<Interaction> &out) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    std::cerr << "Failed to read " << path << "\n";
+    return false;
+  }
+
+  std::string line;
+  size_t number = 0;
+  while (std::getline(in, line)) {
+    ++number;
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+    try {
+      nlohmann::json record = nlohmann::json::parse(line);
+      Interaction interaction;
+      interaction.method = record.at("method").get<std::string>();
+      interaction.target = record.at("target").get<std::string>();
+      interaction.request_body = get_body(record, "request_body");
+      interaction.status = record.at("status").get<long>();
+      const auto headers = record.value("headers", nlohmann::json::array());
+      for (const auto &header : headers)
+        interaction.headers.emplace_back(header.at(0).get<std::string>(),
+                                         header.at(1).get<std::string>());
+      interaction.body = get_body(record, "body");
+      out.push_back(std::move(interaction));
+    } catch (const std::exception &e) {
+      std::cerr << path << ":" << number << ": invalid interaction ("
+                << e.what() << ")\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace cassette
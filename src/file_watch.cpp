@@ -0,0 +1,202 @@
+#include "file_watch.hpp"
+#include "json_utils.hpp"
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <fnmatch.h>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace file_watch {
+
+namespace {
+
+std::atomic<bool> interrupt_requested{false};
+
+// A second Ctrl-C kills the process as usual
+void on_interrupt(int) {
+  interrupt_requested = true;
+  std::signal(SIGINT, SIG_DFL);
+}
+
+std::string case_name(const nlohmann::json &testCase) {
+  const auto it = testCase.find("test_name");
+  if (it == testCase.end())
+    return std::string();
+  return it->is_string() ? it->get<std::string>() : it->dump();
+}
+
+// "exp/{{id}}.json" -> "exp/*.json"
+std::string placeholder_pattern(const std::string &path) {
+  std::string pattern;
+  size_t pos = 0;
+  while (true) {
+    size_t open = path.find("{{", pos);
+    size_t close =
+        open == std::string::npos ? open : path.find("}}", open + 2);
+    if (close == std::string::npos) {
+      pattern.append(path, pos, std::string::npos);
+      return pattern;
+    }
+    pattern.append(path, pos, open - pos);
+    pattern += '*';
+    pos = close + 2;
+  }
+}
+
+} // namespace
+
+std::string absolute(const std::string &path) {
+  return std::filesystem::absolute(path).lexically_normal().string();
+}
+
+Watcher::Watcher() : fd(inotify_init1(IN_CLOEXEC)) {
+  if (fd < 0) {
+    std::cerr << "Failed to start watching files: " << std::strerror(errno)
+              << "\n";
+    return;
+  }
+  interrupt_requested = false;
+  previous_handler = std::signal(SIGINT, on_interrupt);
+}
+
+Watcher::~Watcher() {
+  if (fd < 0)
+    return;
+  std::signal(SIGINT, previous_handler);
+  close(fd);
+}
+
+bool Watcher::interrupted() const { return interrupt_requested; }
+
+void Watcher::add(const std::string &path) {
+  if (fd < 0)
+    return;
+  std::string dir = std::filesystem::path(absolute(path)).parent_path();
+  if (dir.find("{{") != std::string::npos || !watched.insert(dir).second)
+    return;
+  int wd = inotify_add_watch(fd, dir.c_str(),
+                             IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+  if (wd < 0) {
+    std::cerr << "Cannot watch " << dir << ": " << std::strerror(errno)
+              << "\n";
+    return;
+  }
+  dirs[wd] = dir;
+}
+
+std::set<std::string> Watcher::wait(std::chrono::milliseconds settle) {
+  std::set<std::string> changed;
+  missed = false;
+  if (fd < 0)
+    return changed;
+
+  alignas(inotify_event) char buffer[8192];
+  bool first = true;
+  while (!interrupted()) {
+    // Until the first change, wake up now and then to notice Ctrl-C
+    pollfd readable{fd, POLLIN, 0};
+    int timeout = first ? 100 : static_cast<int>(settle.count());
+    int ready = poll(&readable, 1, timeout);
+    if (ready < 0 && errno == EINTR)
+      continue;
+    if (ready == 0 && first)
+      continue;
+    if (ready <= 0)
+      return changed;
+
+    ssize_t len = read(fd, buffer, sizeof(buffer));
+    if (len < 0 && (errno == EINTR || errno == EAGAIN))
+      continue;
+    if (len < 0) {
+      std::cerr << "Failed to read file changes: " << std::strerror(errno)
+                << "\n";
+      missed = true;
+      return changed;
+    }
+    for (ssize_t pos = 0; pos < len;) {
+      const auto *event =
+          reinterpret_cast<const inotify_event *>(buffer + pos);
+      // The kernel queue filled up and dropped events
+      if (event->mask & IN_Q_OVERFLOW)
+        missed = true;
+      auto dir = dirs.find(event->wd);
+      if (dir != dirs.end() && event->len > 0)
+        changed.insert(dir->second + "/" + event->name);
+      pos += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+    }
+    first = false;
+  }
+  return changed;
+}
+
+std::vector<std::string> case_files(const nlohmann::json &testCase) {
+  std::vector<std::string> files;
+  for (const char *field :
+       {"request_description", "expected_response", "parameters"}) {
+    if (testCase.contains(field) && testCase[field].is_string())
+      files.push_back(testCase[field].get<std::string>());
+  }
+  return files;
+}
+
+std::vector<size_t> cases_using(const nlohmann::json &test_cases,
+                                const std::set<std::string> &changed) {
+  std::vector<size_t> result;
+  for (size_t i = 0; i < test_cases.size(); ++i) {
+    bool uses = false;
+    for (const auto &file : case_files(test_cases[i])) {
+      std::string path = absolute(file);
+      if (!json_utils::has_placeholders(file)) {
+        uses = changed.count(path) > 0;
+      } else {
+        std::string pattern = placeholder_pattern(path);
+        for (const auto &candidate : changed)
+          if (fnmatch(pattern.c_str(), candidate.c_str(), FNM_PATHNAME) == 0)
+            uses = true;
+      }
+      if (uses)
+        break;
+    }
+    if (uses)
+      result.push_back(i);
+  }
+  return result;
+}
+
+std::vector<size_t> changed_cases(const nlohmann::json &before,
+                                  const nlohmann::json &after) {
+  std::vector<size_t> result;
+  if (!after.is_object() || !after.contains("test_cases") ||
+      !after["test_cases"].is_array())
+    return result;
+  const nlohmann::json &newCases = after["test_cases"];
+
+  // Anything besides the cases (budgets, host limits) may affect them all
+  bool everything = !before.is_object();
+  std::unordered_map<std::string, const nlohmann::json *> previous;
+  if (!everything) {
+    nlohmann::json oldSuite = before, newSuite = after;
+    oldSuite.erase("test_cases");
+    newSuite.erase("test_cases");
+    everything = oldSuite != newSuite;
+
+    auto oldCases = before.find("test_cases");
+    if (oldCases != before.end() && oldCases->is_array())
+      for (const auto &testCase : *oldCases)
+        previous.emplace(case_name(testCase), &testCase);
+  }
+
+  for (size_t i = 0; i < newCases.size(); ++i) {
+    auto it = previous.find(case_name(newCases[i]));
+    if (everything || it == previous.end() || *it->second != newCases[i])
+      result.push_back(i);
+  }
+  return result;
+}
+
+} // namespace file_watch
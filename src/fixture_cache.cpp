@@ -0,0 +1,186 @@
+#include "fixture_cache.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+namespace fixture_cache {
+
+namespace {
+
+// FNV-1a, 64 bit. Only used to find identical fixtures, not for security.
+uint64_t content_hash(const char *data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Whether the file at `path` holds exactly `size` bytes at `data`.
+bool same_bytes(const std::string &path, const char *data, size_t size) {
+  mapped_file::MappedFile file(path, true);
+  return file.ok && file.size == size &&
+         (size == 0 || std::memcmp(file.data, data, size) == 0);
+}
+
+Document parse_content(const char *data, size_t size, bool cbor) {
+  try {
+    if (cbor)
+      return std::make_shared<const nlohmann::json>(
+          suite_bundle::Bundle::decode(data, size));
+    return std::make_shared<const nlohmann::json>(
+        nlohmann::json::parse(data, data + size));
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+// Whether `pending` already holds `doc`. Never waits: a load still in flight
+// needs the cache's lock to finish, and it is a different document anyway.
+bool holds(const std::shared_future<Document> &pending, const Document &doc) {
+  return pending.wait_for(std::chrono::seconds(0)) ==
+             std::future_status::ready &&
+         pending.get() == doc;
+}
+
+} // namespace
+
+Document FixtureCache::load(const std::string &path) {
+  std::promise<Document> promise;
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    ++counters.lookups;
+    auto it = by_path.find(path);
+    if (it != by_path.end()) {
+      std::shared_future<Document> pending = it->second;
+      lock.unlock();
+      return pending.get();
+    }
+    by_path.emplace(path, promise.get_future().share());
+    ++counters.files_read;
+  }
+
+  Document doc = read_file(path);
+  promise.set_value(doc);
+  return doc;
+}
+
+size_t FixtureCache::invalidate(const std::string &path) {
+  namespace fs = std::filesystem;
+  const fs::path target = fs::absolute(path).lexically_normal();
+
+  std::vector<std::shared_future<Document>> dropped;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = by_path.begin(); it != by_path.end();) {
+      if (fs::absolute(it->first).lexically_normal() != target) {
+        ++it;
+        continue;
+      }
+      dropped.push_back(it->second);
+      it = by_path.erase(it);
+    }
+  }
+
+  // A load of the file still in flight takes the lock to finish, so it is
+  // waited for outside of it
+  std::vector<Document> docs;
+  for (const auto &pending : dropped)
+    docs.push_back(pending.get());
+
+  // The old contents go too, unless another name still refers to them
+  std::lock_guard<std::mutex> lock(mtx);
+  for (const Document &doc : docs) {
+    if (!doc)
+      continue;
+    templates.erase(doc.get());
+    bool shared = std::any_of(
+        by_path.begin(), by_path.end(),
+        [&](const auto &entry) { return holds(entry.second, doc); });
+    if (shared)
+      continue;
+    for (auto it = by_content.begin(); it != by_content.end();) {
+      if (holds(it->second.doc, doc))
+        it = by_content.erase(it);
+      else
+        ++it;
+    }
+  }
+  return dropped.size();
+}
+
+void FixtureCache::clear() {
+  std::lock_guard<std::mutex> lock(mtx);
+  by_path.clear();
+  by_content.clear();
+  templates.clear();
+}
+
+void FixtureCache::set_bundle(
+    std::shared_ptr<const suite_bundle::Bundle> source) {
+  bundle = std::move(source);
+}
+
+Document FixtureCache::read_file(const std::string &path) {
+  const char *data = nullptr;
+  size_t size = 0;
+  bool cbor = bundle && bundle->find(path, data, size);
+
+  std::unique_ptr<mapped_file::MappedFile> file;
+  if (!cbor) {
+    file = std::make_unique<mapped_file::MappedFile>(path, true);
+    if (!file->ok)
+      return nullptr;
+    data = file->data;
+    size = file->size;
+  }
+
+  ContentKey key{cbor ? reinterpret_cast<uintptr_t>(data)
+                      : content_hash(data, size),
+                 size, cbor};
+  std::promise<Document> promise;
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    auto it = by_content.find(key);
+    if (it != by_content.end()) {
+      Content found = it->second;
+      lock.unlock();
+      if (cbor || same_bytes(found.path, data, size))
+        return found.doc.get();
+      // A different file with the same hash: parsed on its own, not shared
+      lock.lock();
+      ++counters.parsed;
+      counters.bytes_parsed += size;
+      lock.unlock();
+      return parse_content(data, size, cbor);
+    }
+    by_content.emplace(key, Content{promise.get_future().share(), path});
+    ++counters.parsed;
+    counters.bytes_parsed += size;
+  }
+
+  Document doc = parse_content(data, size, cbor);
+  promise.set_value(doc);
+  return doc;
+}
+
+std::shared_ptr<const json_utils::Template>
+FixtureCache::template_for(const Document &doc) {
+  std::lock_guard<std::mutex> lock(mtx);
+  // The template holds on to the document, so its address stays a valid key
+  auto &compiled = templates[doc.get()];
+  if (!compiled)
+    compiled = std::make_shared<const json_utils::Template>(doc);
+  return compiled;
+}
+
+FixtureCache::Stats FixtureCache::stats() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return counters;
+}
+
+} // namespace fixture_cache
@@ -0,0 +1,85 @@
+#include "histogram.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace histogram {
+
+namespace {
+constexpr int kSubBucketBits = 11;
+constexpr uint64_t kSubBuckets = 1ULL << kSubBucketBits; // exact range
+constexpr uint64_t kHalfSubBuckets = kSubBuckets / 2;
+constexpr int kMaxValueBits = 36; // ~19 hours in microseconds
+constexpr uint64_t kMaxTrackable = (1ULL << kMaxValueBits) - 1;
+constexpr size_t kBucketCount =
+    kSubBuckets + (kMaxValueBits - kSubBucketBits) * kHalfSubBuckets;
+} // namespace
+
+Histogram::Histogram() : counts(kBucketCount, 0) {}
+
+size_t Histogram::index_for(uint64_t value) {
+  if (value < kSubBuckets)
+    return static_cast<size_t>(value);
+  int msb = 63 - __builtin_clzll(value);
+  int shift = msb - (kSubBucketBits - 1);
+  uint64_t top = value >> shift; // in [kHalfSubBuckets, kSubBuckets)
+  return static_cast<size_t>(kSubBuckets + (shift - 1) * kHalfSubBuckets +
+                             (top - kHalfSubBuckets));
+}
+
+uint64_t Histogram::highest_equivalent(size_t index) {
+  if (index < kSubBuckets)
+    return index;
+  uint64_t k = index - kSubBuckets;
+  int shift = static_cast<int>(k / kHalfSubBuckets) + 1;
+  uint64_t top = k % kHalfSubBuckets + kHalfSubBuckets;
+  return (top << shift) + ((1ULL << shift) - 1);
+}
+
+void Histogram::record(uint64_t value) {
+  uint64_t clamped = std::min(value, kMaxTrackable);
+  ++counts[index_for(clamped)];
+  ++total;
+  sum += value;
+  min_value = std::min(min_value, value);
+  max_value = std::max(max_value, value);
+}
+
+void Histogram::merge(const Histogram &other) {
+  for (size_t i = 0; i < counts.size(); ++i)
+    counts[i] += other.counts[i];
+  total += other.total;
+  sum += other.sum;
+  min_value = std::min(min_value, other.min_value);
+  max_value = std::max(max_value, other.max_value);
+}
+
+void Histogram::reset() {
+  std::fill(counts.begin(), counts.end(), 0);
+  total = 0;
+  sum = 0;
+  min_value = UINT64_MAX;
+  max_value = 0;
+}
+
+double Histogram::mean() const {
+  return total ? static_cast<double>(sum / total) : 0.0;
+}
+
+uint64_t Histogram::value_at_percentile(double percentile) const {
+  if (total == 0)
+    return 0;
+  percentile = std::clamp(percentile, 0.0, 100.0);
+  uint64_t target = static_cast<uint64_t>(
+      std::ceil(percentile / 100.0 * static_cast<double>(total)));
+  target = std::max<uint64_t>(target, 1);
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    seen += counts[i];
+    if (seen >= target)
+      return std::min(highest_equivalent(i), max_value);
+  }
+  return max_value;
+}
+
+} // namespace histogram
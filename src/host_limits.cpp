@@ -0,0 +1,220 @@
+#include "host_limits.hpp"
+#include "trace.hpp"
+#include <algorithm>
+
+namespace host_limits {
+
+namespace {
+
+bool parse_limit(const std::string &key, const nlohmann::json &entry,
+                 Limit &limit, std::string &error) {
+  if (!entry.is_object()) {
+    error = "host_limits \"" + key + "\" must be an object";
+    return false;
+  }
+  if (entry.contains("max_concurrency")) {
+    const auto &value = entry["max_concurrency"];
+    if (!value.is_number_integer() || value.get<long long>() < 0) {
+      error = "host_limits \"" + key +
+              "\": 'max_concurrency' must be a non-negative integer";
+      return false;
+    }
+    limit.max_concurrency = value.get<size_t>();
+  }
+  if (entry.contains("rate")) {
+    const auto &value = entry["rate"];
+    if (!value.is_number() || value.get<double>() < 0) {
+      error = "host_limits \"" + key + "\": 'rate' must be a non-negative "
+                                       "number of requests per second";
+      return false;
+    }
+    limit.rate = value.get<double>();
+  }
+  if (entry.contains("burst")) {
+    const auto &value = entry["burst"];
+    if (!value.is_number() || value.get<double>() < 1) {
+      error = "host_limits \"" + key + "\": 'burst' must be at least 1";
+      return false;
+    }
+    limit.burst = value.get<double>();
+  }
+  return true;
+}
+
+} // namespace
+
+bool Config::empty() const {
+  return defaults.max_concurrency == 0 && defaults.rate <= 0 && hosts.empty();
+}
+
+const Limit &Config::limit_for(const std::string &host) const {
+  auto it = hosts.find(host);
+  if (it != hosts.end())
+    return it->second;
+  size_t colon = host.rfind(':');
+  if (colon != std::string::npos) {
+    it = hosts.find(host.substr(0, colon));
+    if (it != hosts.end())
+      return it->second;
+  }
+  return defaults;
+}
+
+bool parse_config(const nlohmann::json &suite, Config &config,
+                  std::string &error) {
+  if (!suite.contains("host_limits"))
+    return true;
+  const auto &limits = suite["host_limits"];
+  if (!limits.is_object()) {
+    error = "'host_limits' must be an object keyed by host";
+    return false;
+  }
+  for (const auto &[key, entry] : limits.items()) {
+    if (key == "*") {
+      if (!parse_limit(key, entry, config.defaults, error))
+        return false;
+      continue;
+    }
+    std::string host = key;
+    std::transform(host.begin(), host.end(), host.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (!parse_limit(key, entry, config.hosts[host], error))
+      return false;
+  }
+  return true;
+}
+
+HostScheduler::HostScheduler(Config config, Start start)
+    : config(std::move(config)), start(std::move(start)),
+      timer(&HostScheduler::timer_loop, this) {}
+
+HostScheduler::~HostScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = true;
+  }
+  timer_cv.notify_all();
+  timer.join();
+}
+
+void HostScheduler::submit(size_t item, const std::string &host,
+                           double cost) {
+  std::vector<size_t> startable;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto now = Clock::now();
+    auto [it, inserted] = hosts.try_emplace(host);
+    if (inserted) {
+      it->second.limit = config.limit_for(host);
+      it->second.tokens = it->second.limit.burst;
+      it->second.refilled = now;
+    }
+    it->second.queue.push_back({item, cost, now});
+    ++queued;
+    wake_at = take_startable(startable);
+  }
+  timer_cv.notify_one();
+  start_all(startable);
+}
+
+void HostScheduler::done(const std::string &host) {
+  std::vector<size_t> startable;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    --hosts.at(host).running;
+    --running;
+    wake_at = take_startable(startable);
+    if (queued == 0 && running == 0)
+      idle_cv.notify_all();
+  }
+  timer_cv.notify_one();
+  start_all(startable);
+}
+
+bool HostScheduler::idle() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return queued == 0 && running == 0;
+}
+
+void HostScheduler::wait_idle() {
+  std::unique_lock<std::mutex> lock(mtx);
+  idle_cv.wait(lock, [this] { return queued == 0 && running == 0; });
+}
+
+std::map<std::string, HostScheduler::HostStats> HostScheduler::stats() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  std::map<std::string, HostStats> result;
+  for (const auto &[name, host] : hosts)
+    result[name] = host.stats;
+  return result;
+}
+
+HostScheduler::Clock::time_point
+HostScheduler::take_startable(std::vector<size_t> &out) {
+  auto now = Clock::now();
+  auto next = Clock::time_point::max();
+  for (auto &[name, host] : hosts) {
+    const Limit &limit = host.limit;
+    while (!host.queue.empty()) {
+      // A full host is woken up again by done()
+      if (limit.max_concurrency > 0 && host.running >= limit.max_concurrency)
+        break;
+      if (limit.rate > 0) {
+        double refill =
+            std::chrono::duration<double>(now - host.refilled).count() *
+            limit.rate;
+        host.tokens = std::min(limit.burst, host.tokens + refill);
+        host.refilled = now;
+        if (host.tokens < 1) {
+          auto wait = std::chrono::duration<double>((1 - host.tokens) /
+                                                    limit.rate);
+          next = std::min(
+              next, now + std::chrono::duration_cast<Clock::duration>(wait));
+          break;
+        }
+        host.tokens -= host.queue.front().cost;
+      }
+
+      Queued front = host.queue.front();
+      host.queue.pop_front();
+      --queued;
+      ++running;
+      ++host.running;
+      ++host.stats.started;
+      host.stats.max_in_flight =
+          std::max(host.stats.max_in_flight, host.running);
+      host.stats.throttled_ms +=
+          std::chrono::duration<double, std::milli>(now - front.since)
+              .count();
+      out.push_back(front.item);
+    }
+  }
+  return next;
+}
+
+void HostScheduler::start_all(const std::vector<size_t> &items) {
+  for (size_t item : items)
+    start(item);
+}
+
+// Starts items whose host was only waiting for its bucket to refill.
+void HostScheduler::timer_loop() {
+  trace::set_thread_name("host limiter");
+  std::unique_lock<std::mutex> lock(mtx);
+  while (!stopping) {
+    if (wake_at == Clock::time_point::max())
+      timer_cv.wait(lock);
+    else
+      timer_cv.wait_until(lock, wake_at);
+    if (stopping || Clock::now() < wake_at)
+      continue;
+
+    std::vector<size_t> startable;
+    wake_at = take_startable(startable);
+    lock.unlock();
+    start_all(startable);
+    lock.lock();
+  }
+}
+
+} // namespace host_limits
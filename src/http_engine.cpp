@@ -0,0 +1,333 @@
+#include "http_engine.hpp"
+#include "http_utils.hpp"
+#include "trace.hpp"
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace http_engine {
+
+struct Engine::Transfer {
+  nlohmann::json request;
+  Completion done;
+  bool parse_body = true;
+  CURL *easy = nullptr;
+  http_utils::RequestState state;
+
+  int64_t trace_start = 0; // on the trace clock, while tracing
+  bool ok = false;
+  http_utils::ResponseInfo info;
+  nlohmann::json response;
+};
+
+Engine::Engine(size_t max_in_flight, thread_pool::ThreadPool *completions)
+    : completions(completions), max_in_flight(max_in_flight) {
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll_fd < 0 || wake_fd < 0) {
+    std::cerr << "Failed to create event loop descriptors\n";
+    return;
+  }
+
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = wake_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+
+  http_utils::global_init();
+  multi = curl_multi_init();
+  if (!multi)
+    return;
+  curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, socket_callback);
+  curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+  curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timer_callback);
+  curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+
+  loop_thread = std::thread(&Engine::loop, this);
+}
+
+Engine::~Engine() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = true;
+  }
+  wake();
+  if (loop_thread.joinable())
+    loop_thread.join();
+
+  for (auto &[raw, transfer] : active) {
+    curl_multi_remove_handle(multi, transfer->easy);
+    curl_easy_cleanup(transfer->easy);
+  }
+  for (CURL *easy : idle_handles)
+    curl_easy_cleanup(easy);
+  if (multi)
+    curl_multi_cleanup(multi);
+  if (wake_fd >= 0)
+    close(wake_fd);
+  if (epoll_fd >= 0)
+    close(epoll_fd);
+}
+
+void Engine::submit(const nlohmann::json &request_desc, Completion done,
+                    bool parse_body) {
+  auto transfer = std::make_shared<Transfer>();
+  transfer->request = request_desc;
+  transfer->done = std::move(done);
+  transfer->parse_body = parse_body;
+  enqueue(std::move(transfer));
+}
+
+void Engine::submit(const nlohmann::json &request_desc, Completion done,
+                    http_utils::BodySink sink) {
+  auto transfer = std::make_shared<Transfer>();
+  transfer->request = request_desc;
+  transfer->done = std::move(done);
+  transfer->parse_body = false;
+  transfer->state.sink = std::move(sink);
+  enqueue(std::move(transfer));
+}
+
+void Engine::enqueue(std::shared_ptr<Transfer> transfer) {
+  if (!multi) {
+    nlohmann::json empty;
+    transfer->done(false, empty, transfer->info);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    incoming.push_back(std::move(transfer));
+    ++outstanding;
+  }
+  wake();
+}
+
+void Engine::wait_idle() {
+  std::unique_lock<std::mutex> lock(mtx);
+  idle_cv.wait(lock, [this] { return outstanding == 0; });
+}
+
+void Engine::cancel() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    cancelling = true;
+  }
+  wake();
+}
+
+void Engine::wake() {
+  if (wake_fd < 0)
+    return;
+  uint64_t one = 1;
+  ssize_t n = write(wake_fd, &one, sizeof(one));
+  (void)n;
+}
+
+int Engine::socket_callback(CURL *, curl_socket_t fd, int what, void *userp,
+                            void *socketp) {
+  Engine *self = static_cast<Engine *>(userp);
+
+  if (what == CURL_POLL_REMOVE) {
+    epoll_ctl(self->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    return 0;
+  }
+
+  epoll_event ev{};
+  ev.data.fd = fd;
+  if (what == CURL_POLL_IN || what == CURL_POLL_INOUT)
+    ev.events |= EPOLLIN;
+  if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT)
+    ev.events |= EPOLLOUT;
+
+  if (socketp) {
+    epoll_ctl(self->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+  } else {
+    epoll_ctl(self->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    curl_multi_assign(self->multi, fd, self); // mark as registered
+  }
+  return 0;
+}
+
+int Engine::timer_callback(CURLM *, long timeout_ms, void *userp) {
+  Engine *self = static_cast<Engine *>(userp);
+  self->timer_ms = timeout_ms;
+  if (timeout_ms >= 0)
+    self->timer_deadline = std::chrono::steady_clock::now() +
+                           std::chrono::milliseconds(timeout_ms);
+  return 0;
+}
+
+// Moves queued submissions into the multi handle, up to max_in_flight.
+void Engine::start_pending() {
+  for (;;) {
+    if (max_in_flight > 0 && active.size() >= max_in_flight)
+      return;
+
+    std::shared_ptr<Transfer> transfer;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (incoming.empty())
+        return;
+      transfer = std::move(incoming.front());
+      incoming.pop_front();
+    }
+
+    if (!idle_handles.empty()) {
+      transfer->easy = idle_handles.back();
+      idle_handles.pop_back();
+      curl_easy_reset(transfer->easy);
+    } else {
+      transfer->easy = curl_easy_init();
+    }
+    if (transfer->easy)
+      http_utils::attach_share(transfer->easy);
+
+    if (!transfer->easy ||
+        !http_utils::prepare_request(transfer->easy, transfer->request,
+                                     transfer->state)) {
+      if (transfer->easy)
+        idle_handles.push_back(transfer->easy);
+      transfer->easy = nullptr;
+      complete(transfer);
+      continue;
+    }
+
+    transfer->trace_start = trace::now();
+    curl_easy_setopt(transfer->easy, CURLOPT_PRIVATE, transfer.get());
+    active.emplace(transfer.get(), transfer);
+    curl_multi_add_handle(multi, transfer->easy);
+  }
+}
+
+// A hung socket may not report progress for a long while, so the loop drops
+// its transfers itself instead of waiting for curl's progress callback.
+void Engine::abort_all() {
+  std::deque<std::shared_ptr<Transfer>> queued;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    queued.swap(incoming);
+  }
+  for (auto &transfer : queued)
+    complete(transfer);
+
+  std::vector<Transfer *> inflight;
+  for (const auto &entry : active)
+    inflight.push_back(entry.first);
+  for (Transfer *transfer : inflight)
+    finish(transfer, CURLE_ABORTED_BY_CALLBACK);
+}
+
+void Engine::drain_completed() {
+  int pending_msgs = 0;
+  while (CURLMsg *msg = curl_multi_info_read(multi, &pending_msgs)) {
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+    char *priv = nullptr;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+    finish(reinterpret_cast<Transfer *>(priv), msg->data.result);
+  }
+}
+
+void Engine::finish(Transfer *raw, CURLcode result) {
+  auto it = active.find(raw);
+  if (it == active.end())
+    return;
+  std::shared_ptr<Transfer> transfer = std::move(it->second);
+  active.erase(it);
+
+  if (trace::enabled())
+    trace::record_async("network", reinterpret_cast<uintptr_t>(raw),
+                        transfer->trace_start, trace::now());
+  http_utils::collect_response_info(transfer->easy, transfer->info);
+  http_utils::record_connection(transfer->easy);
+  if (result == CURLE_OK)
+    http_utils::record_transfer(transfer->easy, transfer->state);
+  curl_multi_remove_handle(multi, transfer->easy);
+  idle_handles.push_back(transfer->easy);
+  transfer->easy = nullptr;
+
+  if (result != CURLE_OK && !transfer->state.sink_aborted) {
+    http_utils::report_error(result);
+  } else {
+    transfer->ok = true;
+  }
+  complete(transfer);
+}
+
+void Engine::complete(const std::shared_ptr<Transfer> &transfer) {
+  auto run = [this, transfer] {
+    if (transfer->ok && transfer->parse_body)
+      transfer->info.phases.parse_us = http_utils::parse_response(
+          transfer->state.response, transfer->response);
+    transfer->done(transfer->ok, transfer->response, transfer->info);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    if (--outstanding == 0)
+      idle_cv.notify_all();
+  };
+
+  if (completions)
+    completions->submit(run);
+  else
+    run();
+}
+
+void Engine::loop() {
+  trace::set_thread_name("engine");
+  constexpr int kMaxEvents = 256;
+  epoll_event events[kMaxEvents];
+  int running = 0;
+
+  for (;;) {
+    bool abort = false;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (stopping)
+        return;
+      std::swap(abort, cancelling);
+    }
+    if (abort)
+      abort_all();
+
+    start_pending();
+
+    int wait_ms = -1;
+    if (timer_ms >= 0) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      timer_deadline - std::chrono::steady_clock::now())
+                      .count();
+      wait_ms = left > 0 ? static_cast<int>(left) : 0;
+    }
+
+    int n = epoll_wait(epoll_fd, events, kMaxEvents, wait_ms);
+    for (int i = 0; i < n; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == wake_fd) {
+        uint64_t count;
+        while (read(wake_fd, &count, sizeof(count)) > 0) {
+        }
+        continue;
+      }
+
+      int flags = 0;
+      if (events[i].events & EPOLLIN)
+        flags |= CURL_CSELECT_IN;
+      if (events[i].events & EPOLLOUT)
+        flags |= CURL_CSELECT_OUT;
+      if (events[i].events & (EPOLLERR | EPOLLHUP))
+        flags |= CURL_CSELECT_ERR;
+      curl_multi_socket_action(multi, fd, flags, &running);
+    }
+
+    if (timer_ms >= 0 && std::chrono::steady_clock::now() >= timer_deadline) {
+      timer_ms = -1;
+      curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    }
+
+    drain_completed();
+  }
+}
+
+} // namespace http_engine
@@ -1,74 +1,423 @@
 #include "http_utils.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
 #include <curl/curl.h>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 
 namespace http_utils {
 
 static size_t WriteCallback(void *contents, size_t size, size_t nmemb,
                             void *userp) {
-  std::string *response = static_cast<std::string *>(userp);
+  RequestState *state = static_cast<RequestState *>(userp);
   size_t totalSize = size * nmemb;
-  response->append(static_cast<char *>(contents), totalSize);
+  if (state->sink) {
+    if (!state->sink(static_cast<char *>(contents), totalSize)) {
+      state->sink_aborted = true;
+      return 0; // makes curl fail the transfer with CURLE_WRITE_ERROR
+    }
+    if (!state->recording)
+      return totalSize;
+  }
+  state->response.append(static_cast<char *>(contents), totalSize);
   return totalSize;
 }
 
-bool make_request_from_json(const nlohmann::json &request_desc,
-                            nlohmann::json &response_out) {
-  CURL *curl = curl_easy_init();
-  if (!curl)
+// Polled by curl while a transfer runs, about once a second even when no
+// data moves, so a hung socket is still dropped soon after a cancellation.
+static int ProgressCallback(void *, curl_off_t, curl_off_t, curl_off_t,
+                            curl_off_t) {
+  return cancelled() ? 1 : 0; // 1 fails with CURLE_ABORTED_BY_CALLBACK
+}
+
+static size_t HeaderCallback(char *buffer, size_t size, size_t nitems,
+                             void *userp) {
+  RequestState *state = static_cast<RequestState *>(userp);
+  size_t totalSize = size * nitems;
+  // A new status line starts a new header block (redirects, 100 Continue)
+  if (totalSize >= 5 && std::string(buffer, 5) == "HTTP/")
+    state->response_headers.clear();
+  state->response_headers.append(buffer, totalSize);
+  return totalSize;
+}
+
+// DNS entries and TLS sessions are shared by every handle in the process.
+// Connections are not: libcurl does not support one connection cache across
+// concurrent threads, so each worker keeps its own persistent easy handle
+// (and with it a private pool of keep-alive connections).
+namespace {
+
+std::mutex share_locks[CURL_LOCK_DATA_LAST];
+std::atomic<long> reused_connections{0};
+std::atomic<long> new_connections{0};
+std::atomic<cassette::Recorder *> recorder{nullptr};
+std::string base_url; // written once before the first request
+std::atomic<bool> cancel_requested{false};
+// steady_clock ticks, 0 when the run has no deadline
+std::atomic<std::chrono::steady_clock::rep> deadline_ticks{0};
+
+// Headers that describe the recorded connection rather than the response.
+// The mock server sets its own framing.
+bool is_hop_header(std::string name) {
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return name == "content-length" || name == "transfer-encoding" ||
+         name == "connection" || name == "keep-alive";
+}
+
+void share_lock(CURL *, curl_lock_data data, curl_lock_access, void *) {
+  share_locks[data].lock();
+}
+
+void share_unlock(CURL *, curl_lock_data data, void *) {
+  share_locks[data].unlock();
+}
+
+CURLSH *shared_handle() {
+  static CURLSH *share = [] {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    CURLSH *sh = curl_share_init();
+    if (sh) {
+      curl_share_setopt(sh, CURLSHOPT_LOCKFUNC, share_lock);
+      curl_share_setopt(sh, CURLSHOPT_UNLOCKFUNC, share_unlock);
+      curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+      curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+    return sh;
+  }();
+  return share;
+}
+
+// One easy handle per worker thread, reset between requests so that its
+// connection cache survives for the whole suite.
+struct WorkerHandle {
+  CURL *curl;
+  WorkerHandle() {
+    shared_handle(); // global init must happen before the first easy handle
+    curl = curl_easy_init();
+  }
+  ~WorkerHandle() {
+    if (curl)
+      curl_easy_cleanup(curl);
+  }
+};
+
+} // namespace
+
+void global_init() { shared_handle(); }
+
+void attach_share(CURL *curl) {
+  if (CURLSH *share = shared_handle())
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+}
+
+void record_connection(CURL *curl) {
+  long connects = 0;
+  if (curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects) != CURLE_OK)
+    return;
+  if (connects > 0) {
+    new_connections += connects;
+    return;
+  }
+  // No new connection is also what a transfer that failed before it got
+  // one (DNS, refused, cancelled) reports; only one that has a peer reused
+  // a connection
+  char *ip = nullptr;
+  if (curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip) == CURLE_OK && ip &&
+      *ip)
+    ++reused_connections;
+}
+
+void to_json(nlohmann::json &out, const PhaseTimings &phases) {
+  out = {{"dns", phases.dns_us},           {"connect", phases.connect_us},
+         {"tls", phases.tls_us},           {"ttfb", phases.ttfb_us},
+         {"transfer", phases.transfer_us}, {"total", phases.total_us},
+         {"parse", phases.parse_us},       {"diff", phases.diff_us}};
+}
+
+void collect_response_info(CURL *curl, ResponseInfo &info) {
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &info.status_code);
+
+  curl_off_t lookup = 0, connect = 0, appconnect = 0, pretransfer = 0,
+             starttransfer = 0, total = 0;
+  curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+  curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+  curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+  curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+  curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+  curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+
+  // Marks are cumulative from the start of the transfer and stay 0 for
+  // phases that did not happen (e.g. connect on a reused connection).
+  PhaseTimings &p = info.phases;
+  p.dns_us = lookup;
+  p.connect_us = connect > lookup ? connect - lookup : 0;
+  p.tls_us = appconnect > connect ? appconnect - connect : 0;
+  curl_off_t ready = std::max({lookup, connect, appconnect, pretransfer});
+  p.ttfb_us = starttransfer > ready ? starttransfer - ready : 0;
+  p.transfer_us = total > starttransfer ? total - starttransfer : 0;
+  p.total_us = total;
+  info.api_time_ms = static_cast<int>(total / 1000);
+}
+
+ConnectionStats connection_stats() {
+  return {reused_connections.load(), new_connections.load()};
+}
+
+void set_recorder(cassette::Recorder *target) { recorder = target; }
+
+void set_base_url(const std::string &base) {
+  base_url = base;
+  while (!base_url.empty() && base_url.back() == '/')
+    base_url.pop_back();
+}
+
+std::string host_of(const std::string &url) {
+  const std::string &target = base_url.empty() ? url : base_url;
+  size_t scheme = target.find("://");
+  size_t start = scheme == std::string::npos ? 0 : scheme + 3;
+  size_t end = target.find_first_of("/?#", start);
+  std::string authority = target.substr(start, end - start);
+  size_t at = authority.rfind('@');
+  if (at != std::string::npos)
+    authority.erase(0, at + 1);
+  if (authority.empty())
+    return authority;
+  std::transform(authority.begin(), authority.end(), authority.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+
+  // The last colon after any IPv6 brackets separates the port
+  size_t colon = authority.rfind(':');
+  size_t bracket = authority.rfind(']');
+  if (colon == std::string::npos ||
+      (bracket != std::string::npos && colon < bracket)) {
+    bool https = target.compare(0, 8, "https://") == 0 ||
+                 target.compare(0, 8, "HTTPS://") == 0;
+    authority += https ? ":443" : ":80";
+  }
+  return authority;
+}
+
+void record_transfer(CURL *curl, const RequestState &state) {
+  cassette::Recorder *target = recorder.load();
+  if (!target || !state.recording || state.sink_aborted)
+    return;
+
+  cassette::Interaction interaction;
+  interaction.method = state.method;
+  interaction.target = cassette::target_of(state.url);
+  interaction.request_body = state.body;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &interaction.status);
+  interaction.body = state.response;
+
+  std::istringstream lines(state.response_headers);
+  std::string line;
+  while (std::getline(lines, line)) {
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    size_t colon = line.find(':');
+    if (colon == std::string::npos || line.compare(0, 5, "HTTP/") == 0)
+      continue;
+    std::string name = line.substr(0, colon);
+    if (is_hop_header(name))
+      continue;
+    size_t value = line.find_first_not_of(" \t", colon + 1);
+    interaction.headers.emplace_back(
+        name, value == std::string::npos ? "" : line.substr(value));
+  }
+  target->record(interaction);
+}
+
+RequestState::~RequestState() {
+  if (headers)
+    curl_slist_free_all(headers);
+}
+
+void set_deadline(std::chrono::steady_clock::time_point deadline) {
+  deadline_ticks = deadline.time_since_epoch().count();
+}
+
+void cancel() { cancel_requested = true; }
+
+void reset_cancel() {
+  cancel_requested = false;
+  deadline_ticks = 0;
+}
+
+bool cancelled() {
+  if (cancel_requested.load(std::memory_order_relaxed))
+    return true;
+  auto deadline = deadline_ticks.load(std::memory_order_relaxed);
+  return deadline != 0 &&
+         std::chrono::steady_clock::now().time_since_epoch().count() >=
+             deadline;
+}
+
+void report_error(CURLcode result) {
+  bool cut_short =
+      result == CURLE_ABORTED_BY_CALLBACK || result == CURLE_OPERATION_TIMEDOUT;
+  if (cut_short && cancelled())
+    return;
+  std::cerr << "CURL error: " << curl_easy_strerror(result) << "\n";
+}
+
+bool prepare_request(CURL *curl, const nlohmann::json &request_desc,
+                     RequestState &state) {
+  TRACE_SPAN("request_setup");
+  if (cancelled())
+    return false;
+  if (!request_desc.contains("url") || !request_desc["url"].is_string()) {
+    std::cerr << "Request description is missing a 'url'\n";
     return false;
+  }
 
-  std::string responseStr;
-  curl_easy_setopt(curl, CURLOPT_URL,
-                   request_desc["url"].get<std::string>().c_str());
+  state.url = request_desc["url"].get<std::string>();
+  if (!base_url.empty())
+    state.url = base_url + cassette::target_of(state.url);
+  curl_easy_setopt(curl, CURLOPT_URL, state.url.c_str());
 
   // Method
-  std::string method = request_desc.value("method", "GET");
-  if (method == "POST") {
+  if (request_desc.contains("method") && !request_desc["method"].is_string()) {
+    std::cerr << "Request description has a non-string 'method'\n";
+    return false;
+  }
+  state.method = request_desc.value("method", "GET");
+  if (state.method == "POST") {
     curl_easy_setopt(curl, CURLOPT_POST, 1L);
-  } else if (method != "GET") {
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str());
+  } else if (state.method != "GET") {
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, state.method.c_str());
   }
 
   // Headers
-  struct curl_slist *headers = NULL;
   if (request_desc.contains("headers")) {
     for (auto &[k, v] : request_desc["headers"].items()) {
+      if (!v.is_string()) {
+        std::cerr << "Request header '" << k << "' is not a string\n";
+        return false;
+      }
       std::string h = k + ": " + v.get<std::string>();
-      headers = curl_slist_append(headers, h.c_str());
+      state.headers = curl_slist_append(state.headers, h.c_str());
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, state.headers);
+  }
+
+  // Timeouts in milliseconds; "timeout" is the older name of "timeout_ms"
+  long total_ms = 0;
+  for (const char *key : {"timeout_ms", "timeout"}) {
+    if (request_desc.contains(key) && request_desc[key].is_number()) {
+      total_ms = request_desc[key].get<long>();
+      break;
     }
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
   }
+  if (auto deadline = deadline_ticks.load()) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::duration(deadline) -
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count();
+    if (left <= 0)
+      return false;
+    if (total_ms <= 0 || left < total_ms)
+      total_ms = static_cast<long>(left);
+  }
+  if (total_ms > 0)
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, total_ms);
+  if (request_desc.contains("connect_timeout_ms") &&
+      request_desc["connect_timeout_ms"].is_number()) {
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS,
+                     request_desc["connect_timeout_ms"].get<long>());
+  }
+  curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+  curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
 
   // Body
-  std::string bodyStr;
   if (request_desc.contains("body")) {
-    bodyStr = request_desc["body"].dump();
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, bodyStr.c_str());
+    state.body = request_desc["body"].dump();
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, state.body.c_str());
   }
 
   // Response capture
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseStr);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &state);
+  if (recorder.load()) {
+    state.recording = true;
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &state);
+  }
+  return true;
+}
 
-  CURLcode res = curl_easy_perform(curl);
-  curl_easy_cleanup(curl);
-  if (headers)
-    curl_slist_free_all(headers);
+long long parse_response(const std::string &body,
+                         nlohmann::json &response_out) {
+  TRACE_SPAN("parse");
+  auto start = std::chrono::steady_clock::now();
+  try {
+    response_out = nlohmann::json::parse(body);
+  } catch (...) {
+    response_out = body; // fallback to raw string
+  }
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+namespace {
+
+// Runs one request on the calling thread's persistent handle.
+bool perform(const nlohmann::json &request_desc, RequestState &state,
+             ResponseInfo *info) {
+  static thread_local WorkerHandle worker;
+  CURL *curl = worker.curl;
+  if (!curl)
+    return false;
+
+  curl_easy_reset(curl); // drops options, keeps the connection cache
+  attach_share(curl);
 
-  if (res != CURLE_OK) {
-    std::cerr << "CURL error: " << curl_easy_strerror(res) << "\n";
+  if (!prepare_request(curl, request_desc, state))
     return false;
+
+  CURLcode res;
+  {
+    TRACE_SPAN("network");
+    res = curl_easy_perform(curl);
   }
+  record_connection(curl);
+  if (info)
+    collect_response_info(curl, *info);
 
-  try {
-    response_out = nlohmann::json::parse(responseStr);
-  } catch (...) {
-    response_out = responseStr; // fallback to raw string
+  if (res != CURLE_OK && !state.sink_aborted) {
+    report_error(res);
+    return false;
   }
+  record_transfer(curl, state);
+  return true;
+}
 
+} // namespace
+
+bool make_request_from_json(const nlohmann::json &request_desc,
+                            nlohmann::json &response_out,
+                            ResponseInfo *info) {
+  RequestState state;
+  if (!perform(request_desc, state, info))
+    return false;
+
+  long long parse_us = parse_response(state.response, response_out);
+  if (info)
+    info->phases.parse_us = parse_us;
   return true;
 }
 
+bool stream_request_from_json(const nlohmann::json &request_desc,
+                              const BodySink &sink, ResponseInfo *info) {
+  RequestState state;
+  state.sink = sink;
+  return perform(request_desc, state, info);
+}
+
 } // namespace http_utils
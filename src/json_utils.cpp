@@ -1,10 +1,9 @@
 #include "json_utils.hpp"
+#include "array_align.hpp"
 #include "log_utils.hpp"
+#include <algorithm>
 #include <fstream>
-#include <iostream>
-#include <set>
 #include <sstream>
-#include <unordered_set>
 
 namespace json_utils {
 
@@ -28,175 +27,501 @@ bool write_json(const std::string &path, const nlohmann::json &data) {
   return true;
 }
 
-// Internal recursive diff that writes to a stringstream instead of directly
-// printing
-bool diff_json_collect(const nlohmann::json &expected,
-                       const nlohmann::json &actual, std::stringstream &output,
-                       const std::string &path,
-                       const std::unordered_set<std::string> &ignore,
-                       const std::unordered_set<std::string> &watch,
-                       int indent, int level) {
-  std::set<std::string> keys;
-  if (expected.is_object()) {
-    for (auto &[k, _] : expected.items())
-      keys.insert(k);
+const nlohmann::json *find_path(const nlohmann::json &doc,
+                                const std::string &path) {
+  const nlohmann::json *node = &doc;
+  size_t pos = 0;
+  while (pos < path.size()) {
+    if (path[pos] == '.') {
+      ++pos;
+    } else if (path[pos] == '[') {
+      size_t close = path.find(']', pos);
+      if (close == std::string::npos || close == pos + 1 || !node->is_array())
+        return nullptr;
+      size_t index = 0;
+      for (size_t i = pos + 1; i < close; ++i) {
+        if (path[i] < '0' || path[i] > '9')
+          return nullptr;
+        index = index * 10 + static_cast<size_t>(path[i] - '0');
+      }
+      if (index >= node->size())
+        return nullptr;
+      node = &(*node)[index];
+      pos = close + 1;
+    } else {
+      size_t end = path.find_first_of(".[", pos);
+      if (end == std::string::npos)
+        end = path.size();
+      if (!node->is_object())
+        return nullptr;
+      auto it = node->find(path.substr(pos, end - pos));
+      if (it == node->end())
+        return nullptr;
+      node = &*it;
+      pos = end;
+    }
   }
-  if (actual.is_object()) {
-    for (auto &[k, _] : actual.items())
-      keys.insert(k);
+  return node;
+}
+
+bool has_placeholders(const nlohmann::json &doc) {
+  if (doc.is_string())
+    return doc.get_ref<const std::string &>().find("{{") != std::string::npos;
+  if (doc.is_structured()) {
+    for (const auto &child : doc)
+      if (has_placeholders(child))
+        return true;
   }
+  return false;
+}
 
-  std::string pad(level * indent, ' ');
-  bool hasDifference = false;
+namespace {
 
-  for (const auto &key : keys) {
-    std::string fullpath = path.empty() ? key : path + "." + key;
-    if (ignore.find(fullpath) != ignore.end())
-      continue;
-    
-    // Watch path check
-    bool isWatched = watch.empty();  // Allow all if watch list is empty
-    if (!isWatched) {
-      for (const auto &w : watch) {
-        if (w.rfind(fullpath, 0) == 0) { // watch path starts with fullpath
-          isWatched = true;
-          break;
-        }
-      }
+// Splits `text` into literal text and placeholder names. Returns whether
+// there was any placeholder; an unclosed "{{" is literal text.
+bool split_placeholders(const std::string &text,
+                        std::vector<Template::Part> &parts) {
+  bool found = false;
+  size_t pos = 0;
+  while (true) {
+    size_t open = text.find("{{", pos);
+    size_t close =
+        open == std::string::npos ? open : text.find("}}", open + 2);
+    if (close == std::string::npos) {
+      if (pos < text.size())
+        parts.push_back({text.substr(pos), false});
+      return found;
     }
-    if (!isWatched)
+    if (open > pos)
+      parts.push_back({text.substr(pos, open - pos), false});
+    std::string name = text.substr(open + 2, close - open - 2);
+    name.erase(0, name.find_first_not_of(' '));
+    name.erase(name.find_last_not_of(' ') + 1);
+    parts.push_back({std::move(name), true});
+    found = true;
+    pos = close + 2;
+  }
+}
+
+bool render_placeholders(const std::vector<Template::Part> &parts,
+                         const nlohmann::json &variables, nlohmann::json &out,
+                         std::string &error) {
+  std::string filled;
+  for (const auto &part : parts) {
+    if (!part.variable) {
+      filled += part.text;
       continue;
+    }
+    auto it = variables.find(part.text);
+    if (it == variables.end()) {
+      error = "undefined variable {{" + part.text + "}}";
+      return false;
+    }
+    if (parts.size() == 1) {
+      out = *it;
+      return true;
+    }
+    filled += it->is_string() ? it->get<std::string>() : it->dump();
+  }
+  out = std::move(filled);
+  return true;
+}
 
-    bool inExpected = expected.contains(key);
-    bool inActual = actual.contains(key);
+} // namespace
 
-    const auto &eVal = inExpected ? expected.at(key) : nlohmann::json();
-    const auto &aVal = inActual ? actual.at(key) : nlohmann::json();
+bool substitute(nlohmann::json &doc, const nlohmann::json &variables,
+                std::string &error) {
+  if (doc.is_structured()) {
+    for (auto &child : doc)
+      if (!substitute(child, variables, error))
+        return false;
+    return true;
+  }
+  if (!doc.is_string())
+    return true;
 
-    if (inExpected && !inActual) {
-      hasDifference = true;
-      output << pad << std::string(indent, ' ') << COLOR_RED << "- \"" << key
-             << "\": " << eVal.dump() << COLOR_RESET << ",\n";
-      continue;
-    }
+  std::vector<Template::Part> parts;
+  if (!split_placeholders(doc.get_ref<const std::string &>(), parts))
+    return true;
+  return render_placeholders(parts, variables, doc, error);
+}
 
-    if (!inExpected && inActual) {
-      hasDifference = true;
-      output << pad << std::string(indent, ' ') << COLOR_GREEN << "+ \"" << key
-             << "\": " << aVal.dump() << COLOR_RESET << ",\n";
-      continue;
-    }
+Template::Template(std::shared_ptr<const nlohmann::json> doc)
+    : doc(std::move(doc)) {
+  compile(*this->doc, nlohmann::json::json_pointer());
+}
 
-    if (eVal.is_object() && aVal.is_object()) {
-      std::stringstream nested;
-      bool nestedDiff = diff_json_collect(eVal, aVal, nested, fullpath, ignore,
-                                          watch, indent, level + 1);
-      if (nestedDiff) {
-        hasDifference = true;
-        output << pad << std::string(indent, ' ') << "\"" << key << "\": {\n"
-               << nested.str() << pad << std::string(indent, ' ') << "},\n";
-      } else {
-        output << pad << std::string(indent, ' ') << "\"" << key
-               << "\": " << aVal.dump() << ",\n";
-      }
-    } else if (eVal != aVal) {
-      hasDifference = true;
-      output << pad << std::string(indent, ' ') << COLOR_RED << "- \"" << key
-             << "\": " << eVal.dump() << "," << COLOR_RESET << "\n";
-      output << pad << std::string(indent, ' ') << COLOR_GREEN << "+ \"" << key
-             << "\": " << aVal.dump() << "," << COLOR_RESET << "\n";
+void Template::compile(const nlohmann::json &node,
+                       const nlohmann::json::json_pointer &where) {
+  if (node.is_object()) {
+    for (const auto &[key, child] : node.items())
+      compile(child, where / key);
+  } else if (node.is_array()) {
+    for (size_t i = 0; i < node.size(); ++i)
+      compile(node[i], where / i);
+  } else if (node.is_string()) {
+    Site site{where, {}};
+    if (split_placeholders(node.get_ref<const std::string &>(), site.parts))
+      sites.push_back(std::move(site));
+  }
+}
+
+bool Template::fill(const nlohmann::json &variables, nlohmann::json &out,
+                    std::string &error) const {
+  out = *doc;
+  for (const auto &site : sites) {
+    if (!render_placeholders(site.parts, variables, out[site.where], error))
+      return false;
+  }
+  return true;
+}
+
+DiffFilter::DiffFilter(const std::vector<std::string> &ignore,
+                       const std::vector<std::string> &watch)
+    : ignore(ignore), watch(watch) {}
+
+DiffFilter::Cursor DiffFilter::root() const {
+  return {ignore.root(), watch.root(), array_keys.root()};
+}
+
+DiffFilter::Cursor DiffFilter::step(const Cursor &cursor,
+                                    const std::string &key) const {
+  return {ignore.step_key(cursor.ignore, key),
+          watch.step_key(cursor.watch, key),
+          array_keys.step_key(cursor.keys, key)};
+}
+
+DiffFilter::Cursor DiffFilter::step(const Cursor &cursor, size_t index) const {
+  return {ignore.step_index(cursor.ignore, index),
+          watch.step_index(cursor.watch, index),
+          array_keys.step_index(cursor.keys, index)};
+}
+
+bool DiffFilter::pruned(const Cursor &cursor) const {
+  if (cursor.ignore.matched)
+    return true;
+  return !watch.empty() && path_matcher::PathMatcher::dead(cursor.watch);
+}
+
+void DiffFilter::add_array_key(const std::string &pattern,
+                               const std::string &field) {
+  array_keys.add(pattern);
+  key_fields.push_back(field);
+}
+
+const std::string *DiffFilter::array_key(const Cursor &cursor) const {
+  // Anchored to the array itself, so arrays nested in its elements are not
+  // keyed by a field meant for it
+  size_t pattern = array_keys.matched_pattern(cursor.keys);
+  return pattern < key_fields.size() ? &key_fields[pattern] : nullptr;
+}
+
+bool DiffFilter::reportable(const Cursor &cursor, bool holds_container) const {
+  if (pruned(cursor))
+    return false;
+  if (watch.empty() || cursor.watch.matched)
+    return true;
+  // On the way to a watched path: a lone `**` that has not matched yet does
+  // not count, and a scalar cannot contain the watched value.
+  return cursor.watch.concrete && holds_container;
+}
+
+namespace {
+
+using object_t = nlohmann::json::object_t;
+
+// Appends ".key" (or "key" at the root) or "[i]" to a reusable path buffer
+// and restores it on scope exit.
+class PathScope {
+public:
+  PathScope(std::string &path, const std::string &key)
+      : path(path), mark(path.size()) {
+    if (!path.empty())
+      path += '.';
+    path += key;
+  }
+  PathScope(std::string &path, size_t index) : path(path), mark(path.size()) {
+    path += '[';
+    path += std::to_string(index);
+    path += ']';
+  }
+  ~PathScope() { path.resize(mark); }
+
+private:
+  std::string &path;
+  size_t mark;
+};
+
+// Visits the union of two objects' keys in sorted order. `fn` receives the
+// key and the matching values (nullptr on the side that lacks the key).
+template <typename Fn>
+void merge_keys(const nlohmann::json &expected, const nlohmann::json &actual,
+                Fn &&fn) {
+  static const object_t empty;
+  const object_t &eObj =
+      expected.is_object() ? expected.get_ref<const object_t &>() : empty;
+  const object_t &aObj =
+      actual.is_object() ? actual.get_ref<const object_t &>() : empty;
+
+  auto ei = eObj.begin();
+  auto ai = aObj.begin();
+  while (ei != eObj.end() || ai != aObj.end()) {
+    int cmp = ai == aObj.end()   ? -1
+              : ei == eObj.end() ? 1
+                                 : ei->first.compare(ai->first);
+    if (cmp < 0) {
+      fn(ei->first, &ei->second, nullptr);
+      ++ei;
+    } else if (cmp > 0) {
+      fn(ai->first, nullptr, &ai->second);
+      ++ai;
     } else {
-      output << pad << std::string(indent, ' ') << "\"" << key
-             << "\": " << aVal.dump() << ",\n";
+      fn(ei->first, &ei->second, &ai->second);
+      ++ei;
+      ++ai;
     }
   }
+}
 
-  return hasDifference;
+// Visits the aligned element pairs of two arrays: keyed when the filter
+// names a key field for the array at `cursor`, ordered otherwise. `offset`
+// is passed on to align_ordered (keyed matching needs both arrays whole).
+template <typename Fn>
+void merge_elements(const nlohmann::json &expected,
+                    const nlohmann::json &actual, const DiffFilter &filter,
+                    const DiffFilter::Cursor &cursor, Fn &&fn,
+                    size_t offset = 0) {
+  std::vector<array_align::ElementPair> pairs;
+  const std::string *key = offset == 0 ? filter.array_key(cursor) : nullptr;
+  if (!key || !array_align::align_keyed(expected, actual, *key, pairs))
+    pairs = array_align::align_ordered(expected, actual, offset);
+  for (const auto &pair : pairs)
+    fn(pair);
 }
 
-// Public wrapper that prints the collected diff
-bool diff_json(const nlohmann::json &expected, const nlohmann::json &actual,
-               const std::string &path,
-               const std::unordered_set<std::string> &ignore, 
-               const std::unordered_set<std::string> &watch, int indent,
-               int level) {
-  std::stringstream finalOutput;
-  bool hasDiff = diff_json_collect(expected, actual, finalOutput, path, ignore,
-                                   watch, indent, level);
-  if (hasDiff) {
-    std::string pad(level * indent, ' ');
-    std::cout << pad << "{\n" << finalOutput.str() << pad << "}";
-    if (level > 0)
-      std::cout << ",\n";
-    else
-      std::cout << "\n";
-  }
-  return hasDiff;
+bool same_container(const nlohmann::json &a, const nlohmann::json &b) {
+  return (a.is_object() && b.is_object()) || (a.is_array() && b.is_array());
+}
+
+bool is_container(const nlohmann::json *value) {
+  return value && value->is_structured();
 }
 
-// Compact diff that logs line-by-line for simple structure
-bool diff_json_compact(const nlohmann::json &expected,
-                       const nlohmann::json &actual, const std::string &path,
-                       const std::unordered_set<std::string> &ignore,
-                       const std::unordered_set<std::string> &watch) {
-  std::set<std::string> keys;
-  if (expected.is_object()) {
-    for (auto &[k, _] : expected.items())
-      keys.insert(k);
+struct Collector {
+  const DiffFilter &filter;
+  DiffList &diffs;
+  std::string path;
+
+  void child(const DiffFilter::Cursor &cursor, const nlohmann::json *eVal,
+             const nlohmann::json *aVal) {
+    if (filter.pruned(cursor))
+      return;
+    if (!aVal) {
+      if (filter.reportable(cursor, is_container(eVal)))
+        diffs.push_back({path, DiffKind::Removed, eVal, nullptr});
+    } else if (!eVal) {
+      if (filter.reportable(cursor, is_container(aVal)))
+        diffs.push_back({path, DiffKind::Added, nullptr, aVal});
+    } else {
+      compare(*eVal, *aVal, cursor);
+    }
+  }
+
+  void compare(const nlohmann::json &expected, const nlohmann::json &actual,
+               const DiffFilter::Cursor &cursor) {
+    if (expected.is_object() && actual.is_object()) {
+      merge_keys(expected, actual,
+                 [&](const std::string &key, const nlohmann::json *eVal,
+                     const nlohmann::json *aVal) {
+                   PathScope scope(path, key);
+                   child(filter.step(cursor, key), eVal, aVal);
+                 });
+    } else if (expected.is_array() && actual.is_array()) {
+      // The aligner trims the equal prefix and marks identical pairs, so
+      // equal arrays cost one pass and add nothing
+      elements(expected, actual, cursor, 0);
+    } else if (expected != actual &&
+               filter.reportable(cursor, is_container(&expected) ||
+                                             is_container(&actual))) {
+      diffs.push_back({path, DiffKind::Changed, &expected, &actual});
+    }
   }
-  if (actual.is_object()) {
-    for (auto &[k, _] : actual.items())
-      keys.insert(k);
+
+  void elements(const nlohmann::json &expected, const nlohmann::json &actual,
+                const DiffFilter::Cursor &cursor, size_t offset) {
+    merge_elements(
+        expected, actual, filter, cursor,
+        [&](const array_align::ElementPair &pair) {
+          if (pair.identical)
+            return;
+          PathScope scope(path, pair.index);
+          child(filter.step(cursor, pair.index), pair.expected, pair.actual);
+        },
+        offset);
   }
+};
 
-  bool hasDifference = false;
+struct Renderer {
+  const DiffFilter &filter;
+  const DiffList &diffs;
+  std::ostream &out;
+  int indent;
+  size_t next = 0;
+  std::string path;
 
-  for (const auto &key : keys) {
-    std::string fullpath = path.empty() ? key : path + "." + key;
-    if (ignore.find(fullpath) != ignore.end())
-      continue;
-    
-    // Watch path check
-    bool isWatched = watch.empty();  // Allow all if watch list is empty
-    if (!isWatched) {
-      for (const auto &w : watch) {
-        if (w.rfind(fullpath, 0) == 0) { // watch path starts with fullpath
-          isWatched = true;
-          break;
-        }
-      }
-    }
-    if (!isWatched)
-      continue;
+  const DiffEntry *exact() const {
+    return next < diffs.size() && diffs[next].path == path ? &diffs[next]
+                                                           : nullptr;
+  }
 
-    bool inExpected = expected.contains(key);
-    bool inActual = actual.contains(key);
+  bool subtree_has_diff() const {
+    if (next >= diffs.size())
+      return false;
+    const std::string &p = diffs[next].path;
+    return p.compare(0, path.size(), path) == 0 &&
+           (p.size() == path.size() || p[path.size()] == '.' ||
+            p[path.size()] == '[');
+  }
 
-    const auto &eVal = inExpected ? expected.at(key) : nlohmann::json();
-    const auto &aVal = inActual ? actual.at(key) : nlohmann::json();
+  // One line (or nested block) for an object member or array element.
+  // `label` is "\"key\": " for members and empty for elements.
+  void line(const std::string &label, const DiffFilter::Cursor &cursor,
+            const nlohmann::json *eVal, const nlohmann::json *aVal,
+            int level) {
+    if (filter.pruned(cursor))
+      return;
+    std::string pad(level * indent + indent, ' ');
 
-    if (inExpected && inActual && eVal.is_object() && aVal.is_object()) {
-      if (diff_json_compact(eVal, aVal, fullpath, ignore, watch)) {
-        hasDifference = true;
+    if (const DiffEntry *d = exact()) {
+      ++next;
+      if (d->kind == DiffKind::Removed) {
+        out << pad << COLOR_RED << "- " << label << eVal->dump() << COLOR_RESET
+            << ",\n";
+      } else if (d->kind == DiffKind::Added) {
+        out << pad << COLOR_GREEN << "+ " << label << aVal->dump()
+            << COLOR_RESET << ",\n";
+      } else {
+        out << pad << COLOR_RED << "- " << label << eVal->dump() << ","
+            << COLOR_RESET << "\n";
+        out << pad << COLOR_GREEN << "+ " << label << aVal->dump() << ","
+            << COLOR_RESET << "\n";
       }
-    } else if (inExpected && !inActual) {
-      hasDifference = true;
-      std::cout << COLOR_RED << "-\"" << fullpath << "\":" << eVal.dump()
-                << COLOR_RESET << "\n";
-    } else if (!inExpected && inActual) {
-      hasDifference = true;
-      std::cout << COLOR_GREEN << "+\"" << fullpath << "\":" << aVal.dump()
-                << COLOR_RESET << "\n";
-    } else if (eVal != aVal) {
-      hasDifference = true;
-      std::cout << COLOR_RED << "-\"" << fullpath << "\":" << eVal.dump()
-                << COLOR_RESET << "\n";
-      std::cout << COLOR_GREEN << "+\"" << fullpath << "\":" << aVal.dump()
-                << COLOR_RESET << "\n";
+    } else if (eVal && aVal && same_container(*eVal, *aVal) &&
+               subtree_has_diff()) {
+      bool isObject = aVal->is_object();
+      out << pad << label << (isObject ? "{\n" : "[\n");
+      container(*eVal, *aVal, cursor, level + 1);
+      out << pad << (isObject ? "},\n" : "],\n");
+    } else if (aVal) {
+      out << pad << label << aVal->dump() << ",\n";
+    }
+  }
+
+  void container(const nlohmann::json &expected, const nlohmann::json &actual,
+                 const DiffFilter::Cursor &cursor, int level) {
+    if (actual.is_object()) {
+      merge_keys(expected, actual,
+                 [&](const std::string &key, const nlohmann::json *eVal,
+                     const nlohmann::json *aVal) {
+                   PathScope scope(path, key);
+                   line("\"" + key + "\": ", filter.step(cursor, key), eVal,
+                        aVal, level);
+                 });
+    } else {
+      merge_elements(expected, actual, filter, cursor,
+                     [&](const array_align::ElementPair &pair) {
+                       PathScope scope(path, pair.index);
+                       line("", filter.step(cursor, pair.index),
+                            pair.expected, pair.actual, level);
+                     });
     }
   }
+};
+
+const char *kind_name(DiffKind kind) {
+  switch (kind) {
+  case DiffKind::Added:
+    return "added";
+  case DiffKind::Removed:
+    return "removed";
+  default:
+    return "changed";
+  }
+}
+
+} // namespace
+
+bool diff_collect(const nlohmann::json &expected, const nlohmann::json &actual,
+                  const DiffFilter &filter, DiffList &diffs) {
+  size_t before = diffs.size();
+  Collector collector{filter, diffs, std::string()};
+  collector.path.reserve(128);
+  collector.compare(expected, actual, filter.root());
+  return diffs.size() > before;
+}
+
+bool diff_collect_at(const nlohmann::json *expected,
+                     const nlohmann::json *actual, const DiffFilter &filter,
+                     const DiffFilter::Cursor &cursor, const std::string &path,
+                     DiffList &diffs) {
+  size_t before = diffs.size();
+  Collector collector{filter, diffs, path};
+  collector.child(cursor, expected, actual);
+  return diffs.size() > before;
+}
+
+bool diff_collect_elements(const nlohmann::json &expected,
+                           const nlohmann::json &actual, size_t offset,
+                           const DiffFilter &filter,
+                           const DiffFilter::Cursor &cursor,
+                           const std::string &path, DiffList &diffs) {
+  size_t before = diffs.size();
+  Collector collector{filter, diffs, path};
+  collector.elements(expected, actual, cursor, offset);
+  return diffs.size() > before;
+}
+
+void render_diff(const nlohmann::json &expected, const nlohmann::json &actual,
+                 const DiffFilter &filter, const DiffList &diffs,
+                 std::ostream &out, int indent) {
+  if (diffs.empty())
+    return;
+
+  // Root values of different shape differ as a whole
+  if (!same_container(expected, actual)) {
+    out << COLOR_RED << "- " << expected.dump() << COLOR_RESET << "\n";
+    out << COLOR_GREEN << "+ " << actual.dump() << COLOR_RESET << "\n";
+    return;
+  }
+
+  bool isObject = actual.is_object();
+  Renderer renderer{filter, diffs, out, indent, 0, std::string()};
+  out << (isObject ? "{\n" : "[\n");
+  renderer.container(expected, actual, filter.root(), 0);
+  out << (isObject ? "}\n" : "]\n");
+}
+void render_diff_compact(const DiffList &diffs, std::ostream &out) {
+  for (const auto &d : diffs) {
+    if (d.kind != DiffKind::Added)
+      out << COLOR_RED << "-\"" << d.path << "\":" << d.expected->dump()
+          << COLOR_RESET << "\n";
+    if (d.kind != DiffKind::Removed)
+      out << COLOR_GREEN << "+\"" << d.path << "\":" << d.actual->dump()
+          << COLOR_RESET << "\n";
+  }
+}
 
-  return hasDifference;
+nlohmann::json diff_to_json(const DiffList &diffs) {
+  nlohmann::json result = nlohmann::json::array();
+  for (const auto &d : diffs) {
+    nlohmann::json entry = {{"path", d.path}, {"kind", kind_name(d.kind)}};
+    if (d.expected)
+      entry["expected"] = *d.expected;
+    if (d.actual)
+      entry["actual"] = *d.actual;
+    result.push_back(std::move(entry));
+  }
+  return result;
 }
 
 } // namespace json_utils
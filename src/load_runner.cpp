@@ -0,0 +1,148 @@
+#include "load_runner.hpp"
+#include "fixture_cache.hpp"
+#include "http_engine.hpp"
+#include "log_utils.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace load_runner {
+
+namespace {
+
+bool collect_requests(const nlohmann::json &spec,
+                      std::vector<nlohmann::json> &requests) {
+  std::vector<const nlohmann::json *> cases;
+  if (spec.contains("test_cases") && spec["test_cases"].is_array()) {
+    for (const auto &testCase : spec["test_cases"])
+      cases.push_back(&testCase);
+  } else {
+    cases.push_back(&spec);
+  }
+
+  fixture_cache::FixtureCache fixtures;
+  for (const auto *testCase : cases) {
+    if (!testCase->contains("request_description"))
+      continue;
+    const nlohmann::json &field = (*testCase)["request_description"];
+    if (!field.is_string()) {
+      auto name = testCase->find("test_name");
+      std::cerr << "Invalid test case "
+                << (name == testCase->end() ? "(unnamed)" : name->dump())
+                << ": 'request_description' must be a file path\n";
+      return false;
+    }
+    std::string path = field;
+    fixture_cache::Document request_desc = fixtures.load(path);
+    if (!request_desc) {
+      std::cerr << "Failed to read JSON from " << path << "\n";
+      return false;
+    }
+    requests.push_back(*request_desc);
+  }
+  return !requests.empty();
+}
+
+double to_ms(uint64_t us) { return static_cast<double>(us) / 1000.0; }
+
+} // namespace
+
+bool run_load(const nlohmann::json &spec, const LoadOptions &options,
+              LoadReport &report) {
+  if (options.rate_per_sec <= 0 || options.duration_sec <= 0) {
+    std::cerr << "Load rate and duration must be positive\n";
+    return false;
+  }
+
+  std::vector<nlohmann::json> requests;
+  if (!collect_requests(spec, requests)) {
+    std::cerr << "No requests to replay\n";
+    return false;
+  }
+
+  http_engine::Engine engine(options.max_in_flight);
+  if (!engine.ok()) {
+    std::cerr << "Failed to start the async request engine\n";
+    return false;
+  }
+
+  using clock = std::chrono::steady_clock;
+  std::mutex report_mutex;
+  report.target_rate = options.rate_per_sec;
+
+  const uint64_t total = static_cast<uint64_t>(options.rate_per_sec *
+                                               options.duration_sec);
+  const auto interval = std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(1.0 / options.rate_per_sec));
+  const auto start = clock::now();
+
+  for (uint64_t i = 0; i < total; ++i) {
+    const auto due = start + interval * static_cast<clock::rep>(i);
+    std::this_thread::sleep_until(due);
+
+    engine.submit(
+        requests[i % requests.size()],
+        [&report, &report_mutex, due](bool ok, nlohmann::json &,
+                                      const http_utils::ResponseInfo &info) {
+          auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+                             clock::now() - due)
+                             .count();
+          std::lock_guard<std::mutex> lock(report_mutex);
+          report.latency_us.record(static_cast<uint64_t>(latency));
+          if (!ok || info.status_code >= 400)
+            ++report.errors;
+        },
+        false);
+    ++report.sent;
+  }
+
+  engine.wait_idle();
+  report.elapsed_sec =
+      std::chrono::duration<double>(clock::now() - start).count();
+  return true;
+}
+
+void print_report(const LoadReport &report, std::ostream &out) {
+  const auto &h = report.latency_us;
+  double throughput =
+      report.elapsed_sec > 0 ? report.sent / report.elapsed_sec : 0.0;
+  double error_rate =
+      report.sent ? 100.0 * report.errors / report.sent : 0.0;
+
+  out << std::fixed << std::setprecision(2);
+  out << "\nRequests: " << report.sent << " in " << report.elapsed_sec
+      << " s (target " << report.target_rate << " req/s)\n";
+  out << "Throughput: " << throughput << " req/s | ";
+  out << (report.errors ? COLOR_RED : COLOR_GREEN) << "Errors: " << error_rate
+      << "% (" << report.errors << ")" << COLOR_RESET << "\n";
+  out << COLOR_BLUE << "Latency (ms): p50 " << to_ms(h.value_at_percentile(50))
+      << " | p90 " << to_ms(h.value_at_percentile(90)) << " | p99 "
+      << to_ms(h.value_at_percentile(99)) << " | p99.9 "
+      << to_ms(h.value_at_percentile(99.9)) << " | max " << to_ms(h.max())
+      << COLOR_RESET << "\n";
+  out << std::defaultfloat;
+}
+
+nlohmann::json report_to_json(const LoadReport &report) {
+  const auto &h = report.latency_us;
+  return {{"requests", report.sent},
+          {"errors", report.errors},
+          {"target_rate", report.target_rate},
+          {"elapsed_sec", report.elapsed_sec},
+          {"throughput",
+           report.elapsed_sec > 0 ? report.sent / report.elapsed_sec : 0.0},
+          {"latency_us",
+           {{"p50", h.value_at_percentile(50)},
+            {"p90", h.value_at_percentile(90)},
+            {"p99", h.value_at_percentile(99)},
+            {"p99.9", h.value_at_percentile(99.9)},
+            {"max", h.max()},
+            {"mean", h.mean()}}}};
+}
+
+} // namespace load_runner
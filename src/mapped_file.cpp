@@ -0,0 +1,37 @@
+#include "mapped_file.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mapped_file {
+
+MappedFile::MappedFile(const std::string &path, bool sequential) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  struct stat st {};
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    ok = true;
+    size = static_cast<size_t>(st.st_size);
+    if (size > 0) {
+      void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        ok = false;
+        size = 0;
+      } else {
+        data = static_cast<const char *>(addr);
+        if (sequential)
+          madvise(addr, size, MADV_SEQUENTIAL);
+      }
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data)
+    munmap(const_cast<char *>(data), size);
+}
+
+} // namespace mapped_file
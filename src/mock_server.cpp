@@ -0,0 +1,266 @@
+#include "mock_server.hpp"
+#include "cassette.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace mock_server {
+
+namespace {
+
+constexpr size_t kMaxHeaderBytes = 64 * 1024;
+constexpr size_t kMaxBodyBytes = 64 * 1024 * 1024;
+
+// Recordings of one method and target.
+struct Route {
+  std::vector<const cassette::Interaction *> interactions;
+  std::atomic<size_t> next{0};
+};
+
+class Replayer {
+public:
+  explicit Replayer(std::vector<cassette::Interaction> recorded)
+      : interactions(std::move(recorded)) {
+    for (const auto &interaction : interactions) {
+      auto &route = routes[interaction.method + " " + interaction.target];
+      if (!route)
+        route = std::make_unique<Route>();
+      route->interactions.push_back(&interaction);
+    }
+  }
+
+  // nullptr when nothing was recorded for this method and target.
+  const cassette::Interaction *match(const std::string &method,
+                                     const std::string &target,
+                                     const std::string &body) const {
+    auto it = routes.find(method + " " + target);
+    if (it == routes.end())
+      return nullptr;
+    Route &route = *it->second;
+    size_t count = route.interactions.size();
+    size_t start = route.next.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < count; ++i) {
+      const auto *candidate = route.interactions[(start + i) % count];
+      if (candidate->request_body == body)
+        return candidate;
+    }
+    return route.interactions[start % count];
+  }
+
+  size_t size() const { return interactions.size(); }
+
+private:
+  std::vector<cassette::Interaction> interactions;
+  std::unordered_map<std::string, std::unique_ptr<Route>> routes;
+};
+
+const char *reason_phrase(long status) {
+  switch (status) {
+  case 200: return "OK";
+  case 201: return "Created";
+  case 204: return "No Content";
+  case 301: return "Moved Permanently";
+  case 302: return "Found";
+  case 304: return "Not Modified";
+  case 400: return "Bad Request";
+  case 401: return "Unauthorized";
+  case 403: return "Forbidden";
+  case 404: return "Not Found";
+  case 429: return "Too Many Requests";
+  case 500: return "Internal Server Error";
+  case 502: return "Bad Gateway";
+  case 503: return "Service Unavailable";
+  default: return "Status";
+  }
+}
+
+bool send_all(int fd, const std::string &data) {
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n =
+        ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    sent += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+std::string lower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return s;
+}
+
+std::string response_for(const cassette::Interaction *interaction,
+                         bool keep_alive) {
+  std::string head;
+  const std::string *body;
+  static const std::string missing =
+      "{\"error\":\"no recorded response for this request\"}";
+
+  if (interaction) {
+    head = "HTTP/1.1 " + std::to_string(interaction->status) + " " +
+           reason_phrase(interaction->status) + "\r\n";
+    for (const auto &[name, value] : interaction->headers)
+      head += name + ": " + value + "\r\n";
+    body = &interaction->body;
+  } else {
+    head = "HTTP/1.1 404 Not Found\r\nContent-Type: application/json\r\n";
+    body = &missing;
+  }
+  head += "Content-Length: " + std::to_string(body->size()) + "\r\n";
+  head += keep_alive ? "Connection: keep-alive\r\n\r\n"
+                     : "Connection: close\r\n\r\n";
+  return head + *body;
+}
+
+// Serves requests on one connection until the client closes it.
+void serve_connection(int fd, const Replayer &replayer, int latency_ms) {
+  std::string buffer;
+  char chunk[16 * 1024];
+
+  for (;;) {
+    size_t headerEnd;
+    while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+      if (buffer.size() > kMaxHeaderBytes)
+        return;
+      ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0)
+        return;
+      buffer.append(chunk, static_cast<size_t>(n));
+    }
+
+    // Request line
+    size_t lineEnd = buffer.find("\r\n");
+    std::string requestLine = buffer.substr(0, lineEnd);
+    size_t sp1 = requestLine.find(' ');
+    size_t sp2 = requestLine.rfind(' ');
+    if (sp1 == std::string::npos || sp2 <= sp1)
+      return;
+    std::string method = requestLine.substr(0, sp1);
+    std::string target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+    bool keepAlive = requestLine.compare(sp2 + 1, 8, "HTTP/1.0") != 0;
+
+    // Headers that matter for framing
+    size_t contentLength = 0;
+    size_t pos = lineEnd + 2;
+    while (pos < headerEnd) {
+      size_t end = buffer.find("\r\n", pos);
+      size_t colon = buffer.find(':', pos);
+      if (colon != std::string::npos && colon < end) {
+        std::string name = lower(buffer.substr(pos, colon - pos));
+        size_t valueStart = buffer.find_first_not_of(" \t", colon + 1);
+        std::string value =
+            valueStart < end
+                ? lower(buffer.substr(valueStart, end - valueStart))
+                : "";
+        if (name == "content-length")
+          contentLength = std::strtoull(value.c_str(), nullptr, 10);
+        else if (name == "connection")
+          keepAlive = value == "keep-alive" ||
+                      (keepAlive && value != "close");
+      }
+      pos = end + 2;
+    }
+    if (contentLength > kMaxBodyBytes)
+      return;
+
+    size_t bodyStart = headerEnd + 4;
+    while (buffer.size() < bodyStart + contentLength) {
+      ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+      if (n <= 0)
+        return;
+      buffer.append(chunk, static_cast<size_t>(n));
+    }
+    std::string body = buffer.substr(bodyStart, contentLength);
+    buffer.erase(0, bodyStart + contentLength);
+
+    const cassette::Interaction *interaction =
+        replayer.match(method, target, body);
+    if (latency_ms > 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms));
+    if (!send_all(fd, response_for(interaction, keepAlive)) || !keepAlive)
+      return;
+  }
+}
+
+} // namespace
+
+bool serve(const std::string &cassette_path, const ServeOptions &options) {
+  std::vector<cassette::Interaction> recorded;
+  if (!cassette::load(cassette_path, recorded))
+    return false;
+  // Lives until the process exits; connection threads are detached
+  static std::unique_ptr<Replayer> replayer;
+  replayer = std::make_unique<Replayer>(std::move(recorded));
+
+  int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (listener < 0) {
+    std::cerr << "Failed to create a socket: " << std::strerror(errno) << "\n";
+    return false;
+  }
+  int yes = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(options.port));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      ::listen(listener, SOMAXCONN) < 0) {
+    std::cerr << "Failed to listen on port " << options.port << ": "
+              << std::strerror(errno) << "\n";
+    ::close(listener);
+    return false;
+  }
+  socklen_t addrLen = sizeof(addr);
+  ::getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &addrLen);
+  int port = ntohs(addr.sin_port);
+
+  if (options.announce) {
+    std::cout << "Serving " << replayer->size() << " recorded responses from "
+              << cassette_path << " on http://127.0.0.1:" << port;
+    if (options.latency_ms > 0)
+      std::cout << " with " << options.latency_ms << " ms latency";
+    std::cout << std::endl;
+  }
+  if (options.on_listening)
+    options.on_listening(port);
+
+  for (;;) {
+    int fd = ::accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno == EMFILE || errno == ENFILE) {
+        // Out of descriptors: wait for connections to close
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        continue;
+      }
+      std::cerr << "accept failed: " << std::strerror(errno) << "\n";
+      ::close(listener);
+      return false;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    std::thread([fd, latency = options.latency_ms] {
+      serve_connection(fd, *replayer, latency);
+      ::close(fd);
+    }).detach();
+  }
+}
+
+} // namespace mock_server
@@ -0,0 +1,280 @@
+#include "param_table.hpp"
+#include "json_utils.hpp"
+#include <fstream>
+#include <vector>
+
+namespace param_table {
+
+namespace {
+
+bool ends_with(const std::string &text, const std::string &suffix) {
+  return text.size() >= suffix.size() &&
+         text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+class InlineReader : public Reader {
+public:
+  explicit InlineReader(const nlohmann::json &rows) : rows(rows) {}
+
+  bool next(nlohmann::json &row) override {
+    if (pos >= rows.size())
+      return false;
+    if (!rows[pos].is_object()) {
+      failure = "row " + std::to_string(pos + 1) + " is not an object";
+      return false;
+    }
+    row = rows[pos++];
+    return true;
+  }
+
+private:
+  const nlohmann::json &rows; // part of the suite, which outlives the run
+  size_t pos = 0;
+};
+
+class JsonLinesReader : public Reader {
+public:
+  JsonLinesReader(std::ifstream in, std::string path)
+      : in(std::move(in)), path(std::move(path)) {}
+
+  bool next(nlohmann::json &row) override {
+    std::string line;
+    while (std::getline(in, line)) {
+      ++line_number;
+      if (line.find_first_not_of(" \t\r") == std::string::npos)
+        continue;
+      row = nlohmann::json::parse(line, nullptr, false);
+      if (!row.is_object()) {
+        failure = path + ":" + std::to_string(line_number) +
+                  ": expected one JSON object per line";
+        return false;
+      }
+      return true;
+    }
+    return false;
+  }
+
+private:
+  std::ifstream in;
+  std::string path;
+  size_t line_number = 0;
+};
+
+// RFC 4180: fields separated by commas, optionally quoted, with "" for a
+// quote inside a quoted field, which may also span lines.
+class CsvReader : public Reader {
+public:
+  CsvReader(std::ifstream in, std::string path)
+      : in(std::move(in)), path(std::move(path)) {}
+
+  // Reads the header line.
+  bool start() {
+    if (!read_record(columns)) {
+      if (failure.empty())
+        failure = path + ": missing the header line";
+      return false;
+    }
+    if (!columns.empty() && columns[0].compare(0, 3, "\xEF\xBB\xBF") == 0)
+      columns[0].erase(0, 3); // UTF-8 byte order mark
+    return true;
+  }
+
+  bool next(nlohmann::json &row) override {
+    std::vector<std::string> fields;
+    if (!read_record(fields))
+      return false;
+    if (fields.size() != columns.size()) {
+      failure = path + ":" + std::to_string(line_number) + ": expected " +
+                std::to_string(columns.size()) + " fields, found " +
+                std::to_string(fields.size());
+      return false;
+    }
+    row = nlohmann::json::object();
+    for (size_t i = 0; i < columns.size(); ++i)
+      row[columns[i]] = std::move(fields[i]);
+    return true;
+  }
+
+private:
+  // One record, skipping blank lines. False at the end of the file or on
+  // an unterminated quote.
+  bool read_record(std::vector<std::string> &fields) {
+    std::string line;
+    do {
+      if (!std::getline(in, line))
+        return false;
+      ++line_number;
+      if (!line.empty() && line.back() == '\r')
+        line.pop_back();
+    } while (line.empty());
+
+    std::string field;
+    bool quoted = false;
+    for (size_t i = 0;; ++i) {
+      if (i == line.size()) {
+        if (!quoted)
+          break;
+        // The quoted field goes on on the next line
+        if (!std::getline(in, line)) {
+          failure = path + ":" + std::to_string(line_number) +
+                    ": unterminated quoted field";
+          return false;
+        }
+        ++line_number;
+        if (!line.empty() && line.back() == '\r')
+          line.pop_back();
+        field += '\n';
+        i = static_cast<size_t>(-1);
+        continue;
+      }
+      char c = line[i];
+      if (quoted) {
+        if (c != '"')
+          field += c;
+        else if (i + 1 < line.size() && line[i + 1] == '"')
+          field += line[++i];
+        else
+          quoted = false;
+      } else if (c == '"') {
+        quoted = true;
+      } else if (c == ',') {
+        fields.push_back(std::move(field));
+        field.clear();
+      } else {
+        field += c;
+      }
+    }
+    fields.push_back(std::move(field));
+    return true;
+  }
+
+  std::ifstream in;
+  std::string path;
+  size_t line_number = 0;
+  std::vector<std::string> columns;
+};
+
+} // namespace
+
+bool is_parameterized(const nlohmann::json &testCase) {
+  return testCase.is_object() && testCase.contains("parameters");
+}
+
+std::unique_ptr<Reader> Reader::open(const nlohmann::json &parameters,
+                                     std::string &error) {
+  if (parameters.is_array())
+    return std::make_unique<InlineReader>(parameters);
+  if (!parameters.is_string()) {
+    error = "'parameters' must be an array of rows or the path of a .csv or "
+            ".jsonl file";
+    return nullptr;
+  }
+
+  std::string path = parameters.get<std::string>();
+  bool csv = ends_with(path, ".csv");
+  if (!csv && !ends_with(path, ".jsonl") && !ends_with(path, ".ndjson")) {
+    error = "parameter table " + path + " must be a .csv or .jsonl file";
+    return nullptr;
+  }
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    error = "failed to read parameter table " + path;
+    return nullptr;
+  }
+  if (!csv)
+    return std::make_unique<JsonLinesReader>(std::move(in), path);
+
+  auto reader = std::make_unique<CsvReader>(std::move(in), path);
+  if (!reader->start()) {
+    error = reader->error();
+    return nullptr;
+  }
+  return reader;
+}
+
+Expander::Expander(const nlohmann::json &test_cases, size_t window)
+    : test_cases(test_cases), first_id(test_cases.size()),
+      window(window > 0 ? window : 1), next_id(test_cases.size()) {}
+
+bool Expander::add(size_t index, std::string &error) {
+  auto reader = Reader::open(test_cases[index]["parameters"], error);
+  if (!reader)
+    return false;
+  tables.push_back({index, std::move(reader)});
+  return true;
+}
+
+bool Expander::next(size_t &id, std::string &error) {
+  error.clear();
+  Generated out;
+  while (!tables.empty()) {
+    Table &table = tables.front();
+    const nlohmann::json &testCase = test_cases[table.index];
+    std::string name = testCase.value("test_name", std::string());
+
+    if (!table.reader->next(out.row)) {
+      if (table.reader->error().empty()) {
+        tables.pop_front();
+        continue;
+      }
+      // The rest of the table is unreadable: one failed case stands for it
+      error = table.reader->error();
+      out.spec = testCase;
+      out.spec.erase("parameters");
+      out.spec["test_name"] = name + " [table]";
+      out.parent = table.index;
+      tables.pop_front();
+      break;
+    }
+
+    ++table.rows;
+    out.parent = table.index;
+    out.spec = testCase;
+    out.spec.erase("parameters");
+    // A name without placeholders is told apart by the row number
+    bool named = json_utils::has_placeholders(out.spec["test_name"]);
+    if (!json_utils::substitute(out.spec, out.row, error)) {
+      error = "row " + std::to_string(table.rows) + ": " + error;
+      named = false;
+    }
+    auto &testName = out.spec["test_name"];
+    if (!named)
+      testName = name + " [" + std::to_string(table.rows) + "]";
+    else if (!testName.is_string())
+      testName = testName.dump(); // "{{id}}" alone takes the value's type
+    break;
+  }
+  if (out.spec.is_null())
+    return false;
+
+  std::unique_lock<std::mutex> lock(mtx);
+  room_cv.wait(lock, [this] { return live.size() < window; });
+  id = next_id++;
+  live.emplace(id, std::move(out));
+  return true;
+}
+
+const nlohmann::json &Expander::spec(size_t id) const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return live.at(id).spec;
+}
+
+const nlohmann::json &Expander::row(size_t id) const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return live.at(id).row;
+}
+
+size_t Expander::parent(size_t id) const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return live.at(id).parent;
+}
+
+void Expander::release(size_t id) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    live.erase(id);
+  }
+  room_cv.notify_one();
+}
+
+} // namespace param_table
@@ -0,0 +1,240 @@
+#include "path_matcher.hpp"
+#include <algorithm>
+#include <cctype>
+#include <limits>
+
+namespace path_matcher {
+
+namespace {
+
+enum class TokenKind { Key, AnyKey, Globstar, Index, AnyIndex };
+
+struct Token {
+  TokenKind kind;
+  std::string key;
+  size_t index = 0;
+};
+
+// Parses "[n]" / "[*]" groups following a key. Returns false on anything
+// else so the caller can fall back to a literal key.
+bool parse_brackets(const std::string &part, size_t pos,
+                    std::vector<Token> &out) {
+  while (pos < part.size()) {
+    if (part[pos] != '[')
+      return false;
+    size_t close = part.find(']', pos);
+    if (close == std::string::npos || close == pos + 1)
+      return false;
+    std::string inner = part.substr(pos + 1, close - pos - 1);
+    if (inner == "*") {
+      out.push_back({TokenKind::AnyIndex, "", 0});
+    } else {
+      // An index too large for size_t can match no array; keep it a key
+      size_t index = 0;
+      for (unsigned char c : inner) {
+        if (!std::isdigit(c) ||
+            index > (std::numeric_limits<size_t>::max() - (c - '0')) / 10)
+          return false;
+        index = index * 10 + static_cast<size_t>(c - '0');
+      }
+      out.push_back({TokenKind::Index, "", index});
+    }
+    pos = close + 1;
+  }
+  return true;
+}
+
+std::vector<Token> tokenize(const std::string &pattern) {
+  std::vector<Token> tokens;
+  size_t start = 0;
+  while (start <= pattern.size()) {
+    size_t dot = pattern.find('.', start);
+    if (dot == std::string::npos)
+      dot = pattern.size();
+    std::string part = pattern.substr(start, dot - start);
+    start = dot + 1;
+
+    size_t bracket = part.find('[');
+    std::string name = part.substr(0, bracket);
+    std::vector<Token> indices;
+    if (bracket != std::string::npos &&
+        !parse_brackets(part, bracket, indices)) {
+      name = part; // not an index suffix, treat the whole part as a key
+      indices.clear();
+    }
+
+    if (name == "**")
+      tokens.push_back({TokenKind::Globstar, "", 0});
+    else if (name == "*")
+      tokens.push_back({TokenKind::AnyKey, "", 0});
+    else if (!name.empty() || indices.empty())
+      tokens.push_back({TokenKind::Key, name, 0});
+    tokens.insert(tokens.end(), indices.begin(), indices.end());
+  }
+  return tokens;
+}
+
+} // namespace
+
+PathMatcher::PathMatcher() { new_node(); }
+
+PathMatcher::PathMatcher(const std::vector<std::string> &patterns,
+                         bool anchored)
+    : PathMatcher() {
+  this->anchored = anchored;
+  for (const auto &p : patterns)
+    add(p);
+}
+
+uint32_t PathMatcher::new_node(bool is_globstar) {
+  nodes.emplace_back();
+  nodes.back().is_globstar = is_globstar;
+  return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void PathMatcher::add(const std::string &pattern) {
+  uint32_t cur = 0;
+  for (const auto &token : tokenize(pattern)) {
+    uint32_t next = kNone;
+    switch (token.kind) {
+    case TokenKind::Key: {
+      auto it = nodes[cur].keys.find(token.key);
+      if (it != nodes[cur].keys.end()) {
+        next = it->second;
+      } else {
+        next = new_node();
+        nodes[cur].keys.emplace(token.key, next);
+      }
+      break;
+    }
+    case TokenKind::Index: {
+      indexed = true;
+      auto it = nodes[cur].indices.find(token.index);
+      if (it != nodes[cur].indices.end()) {
+        next = it->second;
+      } else {
+        next = new_node();
+        nodes[cur].indices.emplace(token.index, next);
+      }
+      break;
+    }
+    case TokenKind::AnyKey:
+      if (nodes[cur].any_key == kNone) {
+        next = new_node();
+        nodes[cur].any_key = next;
+      }
+      next = nodes[cur].any_key;
+      break;
+    case TokenKind::AnyIndex:
+      if (nodes[cur].any_index == kNone) {
+        next = new_node();
+        nodes[cur].any_index = next;
+      }
+      next = nodes[cur].any_index;
+      break;
+    case TokenKind::Globstar:
+      if (nodes[cur].globstar == kNone) {
+        next = new_node(true);
+        nodes[cur].globstar = next;
+      }
+      next = nodes[cur].globstar;
+      break;
+    }
+    cur = next;
+  }
+  if (!nodes[cur].terminal)
+    nodes[cur].pattern = pattern_count;
+  nodes[cur].terminal = true;
+  ++pattern_count;
+}
+
+// A node plus every `**` reachable from it without consuming a segment.
+void PathMatcher::add_closure(uint32_t node, std::vector<uint32_t> &out) const {
+  out.push_back(node);
+  if (nodes[node].globstar != kNone)
+    add_closure(nodes[node].globstar, out);
+}
+
+State PathMatcher::finish(std::vector<uint32_t> &next, bool matched) const {
+  State state;
+  std::sort(next.begin(), next.end());
+  next.erase(std::unique(next.begin(), next.end()), next.end());
+  state.matched = matched;
+  for (uint32_t n : next) {
+    state.matched = state.matched || nodes[n].terminal;
+    state.concrete = state.concrete || !nodes[n].is_globstar;
+  }
+  // Everything below a match matches as well; no need to keep stepping.
+  if (!state.matched || anchored)
+    state.nodes = std::move(next);
+  return state;
+}
+
+State PathMatcher::root() const {
+  std::vector<uint32_t> next;
+  if (!empty())
+    add_closure(0, next);
+  return finish(next, false);
+}
+
+State PathMatcher::step_key(const State &state, const std::string &key) const {
+  if (state.matched && !anchored)
+    return State{{}, true, false};
+  if (state.nodes.empty())
+    return State{};
+
+  std::vector<uint32_t> next;
+  for (uint32_t n : state.nodes) {
+    const Node &node = nodes[n];
+    if (node.is_globstar)
+      add_closure(n, next);
+    auto it = node.keys.find(key);
+    if (it != node.keys.end())
+      add_closure(it->second, next);
+    if (node.any_key != kNone)
+      add_closure(node.any_key, next);
+  }
+  return finish(next, false);
+}
+
+State PathMatcher::step_index(const State &state, size_t index) const {
+  if (state.matched && !anchored)
+    return State{{}, true, false};
+  if (state.nodes.empty())
+    return State{};
+
+  std::vector<uint32_t> next;
+  for (uint32_t n : state.nodes) {
+    const Node &node = nodes[n];
+    if (node.is_globstar)
+      add_closure(n, next);
+    auto it = node.indices.find(index);
+    if (it != node.indices.end())
+      add_closure(it->second, next);
+    if (node.any_index != kNone)
+      add_closure(node.any_index, next);
+  }
+  return finish(next, false);
+}
+
+bool PathMatcher::matches(const std::string &path) const {
+  State state = root();
+  for (const auto &token : tokenize(path)) {
+    if (state.matched || state.nodes.empty())
+      break;
+    if (token.kind == TokenKind::Index)
+      state = step_index(state, token.index);
+    else
+      state = step_key(state, token.key);
+  }
+  return state.matched;
+}
+
+size_t PathMatcher::matched_pattern(const State &state) const {
+  size_t first = kNoPattern;
+  for (uint32_t n : state.nodes)
+    first = std::min(first, nodes[n].pattern);
+  return first;
+}
+
+} // namespace path_matcher
@@ -0,0 +1,206 @@
+#include "perf_compare.hpp"
+#include "log_utils.hpp"
+#include "result_sink.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+namespace perf_compare {
+
+namespace {
+
+struct Samples {
+  std::vector<std::string> names; // first-seen order
+  std::unordered_map<std::string, std::vector<double>> by_name;
+};
+
+bool load_samples(const std::string &path, Samples &out) {
+  return result_sink::read_export(path, [&](const nlohmann::json &record) {
+    if (!record.is_object() || !record.contains("test_name"))
+      return;
+    std::string name = record["test_name"].is_string()
+                           ? record["test_name"].get<std::string>()
+                           : record["test_name"].dump();
+
+    std::vector<double> found;
+    if (record.contains("samples_ms") && record["samples_ms"].is_array()) {
+      for (const auto &sample : record["samples_ms"])
+        if (sample.is_number())
+          found.push_back(sample.get<double>());
+    } else if (record.contains("phases_us") &&
+               record["phases_us"].is_object()) {
+      // Zero when the request never got a response
+      double total_us = record["phases_us"].value("total", 0.0);
+      if (total_us > 0)
+        found.push_back(total_us / 1000.0);
+    } else if (record.contains("api_time_ms")) {
+      found.push_back(record.value("api_time_ms", 0.0));
+    }
+    if (found.empty())
+      return;
+
+    auto [it, inserted] = out.by_name.try_emplace(name);
+    if (inserted)
+      out.names.push_back(name);
+    it->second.insert(it->second.end(), found.begin(), found.end());
+  });
+}
+
+double median(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  size_t mid = values.size() / 2;
+  return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+std::string format_ms(double ms) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.1f ms", ms);
+  return text;
+}
+
+} // namespace
+
+double min_p_value(size_t n1, size_t n2) {
+  double combinations = 1;
+  for (size_t i = 1; i <= std::min(n1, n2); ++i)
+    combinations = combinations * static_cast<double>(n1 + n2 - i + 1) /
+                   static_cast<double>(i);
+  return 1 / combinations;
+}
+
+// Latencies are skewed and heavy-tailed, so a rank test is a better fit
+// than comparing means.
+double u_test_p_value(const std::vector<double> &baseline,
+                      const std::vector<double> &current, bool larger) {
+  struct Value {
+    double ms;
+    bool current;
+  };
+  std::vector<Value> pooled;
+  for (double ms : baseline)
+    pooled.push_back({ms, false});
+  for (double ms : current)
+    pooled.push_back({ms, true});
+  std::sort(pooled.begin(), pooled.end(),
+            [](const Value &a, const Value &b) { return a.ms < b.ms; });
+
+  double n1 = static_cast<double>(baseline.size());
+  double n2 = static_cast<double>(current.size());
+  double n = n1 + n2;
+  double rank_sum = 0; // of the current samples
+  double ties = 0;     // sum of t^3 - t over groups of equal values
+  for (size_t i = 0; i < pooled.size();) {
+    size_t j = i;
+    while (j < pooled.size() && pooled[j].ms == pooled[i].ms)
+      ++j;
+    double rank = (static_cast<double>(i + j) + 1) / 2; // 1-based average
+    for (size_t k = i; k < j; ++k)
+      if (pooled[k].current)
+        rank_sum += rank;
+    double t = static_cast<double>(j - i);
+    ties += t * t * t - t;
+    i = j;
+  }
+
+  double u = rank_sum - n2 * (n2 + 1) / 2;
+  double mean = n1 * n2 / 2;
+  double variance = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+  if (variance <= 0)
+    return 1;
+  double z = ((larger ? u - mean : mean - u) - 0.5) / std::sqrt(variance);
+  return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+bool compare(const std::string &baseline_path, const std::string &current_path,
+             const CompareOptions &options, std::ostream &out,
+             CompareSummary &summary) {
+  Samples baseline, current;
+  if (!load_samples(baseline_path, baseline) ||
+      !load_samples(current_path, current))
+    return false;
+
+  int width = 4;
+  for (const auto &name : baseline.names)
+    if (current.by_name.count(name))
+      width = std::max(width,
+                       static_cast<int>(std::min<size_t>(name.size(), 48)));
+
+  char line[256];
+  std::snprintf(line, sizeof(line), "%-*s %12s %12s %9s %8s", width, "Test",
+                "Baseline", "Current", "Change", "p-value");
+  out << line << "\n";
+
+  for (const auto &name : baseline.names) {
+    auto it = current.by_name.find(name);
+    if (it == current.by_name.end()) {
+      ++summary.only_baseline;
+      continue;
+    }
+    const std::vector<double> &before = baseline.by_name[name];
+    const std::vector<double> &after = it->second;
+    ++summary.compared;
+
+    double medianBefore = median(before);
+    double medianAfter = median(after);
+    double change = medianBefore > 0
+                        ? (medianAfter - medianBefore) / medianBefore * 100
+                        : 0;
+
+    bool testable = min_p_value(before.size(), after.size()) < options.alpha;
+    double pSlower = testable ? u_test_p_value(before, after, true) : 1;
+    double pFaster = testable ? u_test_p_value(before, after, false) : 1;
+
+    const char *color = "";
+    std::string verdict;
+    if (change > options.threshold_percent &&
+        (!testable || pSlower < options.alpha)) {
+      ++summary.slower;
+      color = COLOR_RED;
+      verdict = "slower";
+    } else if (change < -options.threshold_percent &&
+               (!testable || pFaster < options.alpha)) {
+      ++summary.faster;
+      color = COLOR_GREEN;
+      verdict = "faster";
+    }
+    if (!testable) {
+      ++summary.untested;
+      if (!verdict.empty())
+        verdict += " (too few samples to test)";
+    }
+
+    char pText[16] = "-";
+    if (testable)
+      std::snprintf(pText, sizeof(pText), "%.4f",
+                    change >= 0 ? pSlower : pFaster);
+    std::string shown = name.size() > 48 ? name.substr(0, 45) + "..." : name;
+    std::snprintf(line, sizeof(line), "%-*s %12s %12s %+8.1f%% %8s", width,
+                  shown.c_str(), format_ms(medianBefore).c_str(),
+                  format_ms(medianAfter).c_str(), change, pText);
+    out << color << line;
+    if (!verdict.empty())
+      out << "  " << verdict << COLOR_RESET;
+    out << "\n";
+  }
+  for (const auto &name : current.names)
+    if (!baseline.by_name.count(name))
+      ++summary.only_current;
+
+  out << "\nCompared " << summary.compared << " tests: " << summary.slower
+      << " slower | " << summary.faster << " faster | "
+      << summary.compared - summary.slower - summary.faster << " unchanged\n";
+  if (summary.only_baseline || summary.only_current)
+    out << "Only in " << baseline_path << ": " << summary.only_baseline
+        << " | only in " << current_path << ": " << summary.only_current
+        << "\n";
+  if (summary.untested)
+    out << "Too few samples for a significance test: " << summary.untested
+        << " (give their cases \"repeat\" to compare distributions instead "
+           "of single runs)\n";
+  return true;
+}
+
+} // namespace perf_compare
@@ -0,0 +1,225 @@
+#include "ping_runner.hpp"
+#include "log_utils.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace ping_runner {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::atomic<bool> interrupted{false};
+
+void on_interrupt(int) { interrupted = true; }
+
+// Sleeps until `due`, waking early when interrupted.
+void sleep_until(Clock::time_point due) {
+  while (!interrupted && Clock::now() < due)
+    std::this_thread::sleep_for(
+        std::min<Clock::duration>(due - Clock::now(),
+                                  std::chrono::milliseconds(100)));
+}
+
+double to_ms(long long us) { return static_cast<double>(us) / 1000.0; }
+
+// One request with the body discarded as it arrives.
+bool probe(const nlohmann::json &request, http_utils::ResponseInfo &info) {
+  return http_utils::stream_request_from_json(
+      request, [](const char *, size_t) { return true; }, &info);
+}
+
+void ping_once(const nlohmann::json &request, const PingOptions &options,
+               TargetReport &report, std::mutex &out_mutex) {
+  const std::string &url = report.url;
+  for (int attempt = 1; attempt <= options.retries && !interrupted;
+       ++attempt) {
+    if (attempt > 1)
+      sleep_until(Clock::now() + std::chrono::milliseconds(options.interval_ms));
+    {
+      std::lock_guard<std::mutex> lock(out_mutex);
+      std::cout << "Pinging " << url << " (attempt " << attempt << " of "
+                << options.retries << ")...\n";
+    }
+
+    http_utils::ResponseInfo info;
+    ++report.sent;
+    bool ok = probe(request, info);
+    std::lock_guard<std::mutex> lock(out_mutex);
+    if (ok) {
+      report.record(to_ms(info.phases.total_us), info.phases);
+      std::cout << "Response received from " << url << " in "
+                << info.api_time_ms << " ms\n";
+      return;
+    }
+    if (attempt < options.retries)
+      std::cerr << "No response from " << url << ". Retrying...\n";
+  }
+  std::lock_guard<std::mutex> lock(out_mutex);
+  std::cerr << "Failed to ping " << url << " after " << options.retries
+            << " attempts.\n";
+}
+
+void ping_continuous(const nlohmann::json &request, const PingOptions &options,
+                     TargetReport &report, std::mutex &out_mutex) {
+  const auto start = Clock::now();
+  const auto interval = std::chrono::milliseconds(options.interval_ms);
+
+  for (int seq = 1; options.count == 0 || seq <= options.count; ++seq) {
+    // Fixed schedule: a slow probe does not push the later ones back
+    sleep_until(start + interval * (seq - 1));
+    if (interrupted)
+      return;
+
+    http_utils::ResponseInfo info;
+    ++report.sent;
+    bool ok = probe(request, info);
+
+    std::lock_guard<std::mutex> lock(out_mutex);
+    if (ok) {
+      double ms = to_ms(info.phases.total_us);
+      report.record(ms, info.phases);
+      std::cout << std::fixed << std::setprecision(2) << report.url << ": "
+                << "seq=" << seq << " status=" << info.status_code
+                << " time=" << ms << " ms\n"
+                << std::defaultfloat;
+    } else {
+      std::cout << COLOR_RED << report.url << ": " << "seq=" << seq
+                << " no response" << COLOR_RESET << "\n";
+    }
+  }
+}
+
+} // namespace
+
+void TargetReport::record(double latency_ms,
+                          const http_utils::PhaseTimings &phases) {
+  ++received;
+  if (received == 1 || latency_ms < min_ms)
+    min_ms = latency_ms;
+  if (received == 1 || latency_ms > max_ms)
+    max_ms = latency_ms;
+
+  double delta = latency_ms - mean_ms;
+  mean_ms += delta / static_cast<double>(received);
+  m2 += delta * (latency_ms - mean_ms);
+
+  if (last_ms >= 0) {
+    ++jitter_samples;
+    jitter_ms += (std::fabs(latency_ms - last_ms) - jitter_ms) /
+                 static_cast<double>(jitter_samples);
+  }
+  last_ms = latency_ms;
+
+  phase_sums.dns_us += phases.dns_us;
+  phase_sums.connect_us += phases.connect_us;
+  phase_sums.tls_us += phases.tls_us;
+  phase_sums.ttfb_us += phases.ttfb_us;
+  phase_sums.transfer_us += phases.transfer_us;
+  phase_sums.total_us += phases.total_us;
+}
+
+double TargetReport::stddev_ms() const {
+  return received > 1 ? std::sqrt(m2 / static_cast<double>(received - 1))
+                      : 0.0;
+}
+
+double TargetReport::loss_percent() const {
+  return sent ? 100.0 * static_cast<double>(sent - received) /
+                    static_cast<double>(sent)
+              : 0.0;
+}
+
+bool run_ping(const std::vector<std::string> &urls, const PingOptions &options,
+              std::vector<TargetReport> &reports) {
+  if (options.interval_ms < 0 || options.count < 0 || options.retries < 1) {
+    std::cerr << "Ping interval and count must not be negative, retries must "
+                 "be at least 1\n";
+    return false;
+  }
+
+  interrupted = false;
+  auto previous = std::signal(SIGINT, on_interrupt);
+
+  reports.assign(urls.size(), TargetReport{});
+  std::mutex out_mutex;
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < urls.size(); ++i) {
+    reports[i].url = urls[i];
+    threads.emplace_back([&, i] {
+      nlohmann::json request = {{"method", "GET"},
+                                {"url", urls[i]},
+                                {"timeout", options.timeout_ms}};
+      if (options.continuous)
+        ping_continuous(request, options, reports[i], out_mutex);
+      else
+        ping_once(request, options, reports[i], out_mutex);
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  std::signal(SIGINT, previous);
+
+  bool all = true;
+  for (const auto &report : reports)
+    all = all && report.received > 0;
+  return all;
+}
+
+void print_report(const std::vector<TargetReport> &reports, std::ostream &out) {
+  out << std::fixed << std::setprecision(2);
+  for (const auto &r : reports) {
+    double n = r.received ? static_cast<double>(r.received) : 1.0;
+    const auto &p = r.phase_sums;
+    out << "\n--- " << r.url << " ---\n";
+    out << r.sent << " sent | " << r.received << " received | "
+        << (r.received < r.sent ? COLOR_RED : COLOR_GREEN) << r.loss_percent()
+        << "% loss" << COLOR_RESET << "\n";
+    if (!r.received)
+      continue;
+    out << COLOR_BLUE << "Latency (ms): min " << r.min_ms << " | avg "
+        << r.mean_ms << " | max " << r.max_ms << " | stddev " << r.stddev_ms()
+        << " | jitter " << r.jitter_ms << COLOR_RESET << "\n";
+    out << COLOR_BLUE << "Phases avg (ms): dns " << to_ms(p.dns_us) / n
+        << " | connect " << to_ms(p.connect_us) / n << " | tls "
+        << to_ms(p.tls_us) / n << " | ttfb " << to_ms(p.ttfb_us) / n
+        << " | transfer " << to_ms(p.transfer_us) / n << COLOR_RESET << "\n";
+  }
+  out << std::defaultfloat;
+}
+
+nlohmann::json report_to_json(const std::vector<TargetReport> &reports) {
+  nlohmann::json targets = nlohmann::json::array();
+  for (const auto &r : reports) {
+    double n = r.received ? static_cast<double>(r.received) : 1.0;
+    const auto &p = r.phase_sums;
+    targets.push_back(
+        {{"url", r.url},
+         {"sent", r.sent},
+         {"received", r.received},
+         {"loss_percent", r.loss_percent()},
+         {"latency_ms",
+          {{"min", r.min_ms},
+           {"avg", r.mean_ms},
+           {"max", r.max_ms},
+           {"stddev", r.stddev_ms()},
+           {"jitter", r.jitter_ms}}},
+         {"phases_avg_us",
+          {{"dns", p.dns_us / n},
+           {"connect", p.connect_us / n},
+           {"tls", p.tls_us / n},
+           {"ttfb", p.ttfb_us / n},
+           {"transfer", p.transfer_us / n}}}});
+  }
+  return targets;
+}
+
+} // namespace ping_runner
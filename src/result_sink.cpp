@@ -0,0 +1,276 @@
+#include "result_sink.hpp"
+#include "trace.hpp"
+#include <cstdio>
+#include <iostream>
+#include <unistd.h>
+
+namespace result_sink {
+
+namespace {
+
+bool ends_with(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+constexpr auto kRedrawInterval = std::chrono::milliseconds(100);
+
+} // namespace
+
+ResultSink::ResultSink(std::ostream &console, size_t total)
+    : console(console), total(total),
+      progress(total > 1 && isatty(STDERR_FILENO)),
+      start(std::chrono::steady_clock::now()) {}
+
+ResultSink::~ResultSink() { finish(); }
+
+bool ResultSink::open_export(const std::string &path,
+                             const nlohmann::json &suite_name) {
+  std::lock_guard<std::mutex> lock(mtx);
+  export_file.open(path);
+  if (!export_file.is_open()) {
+    std::cerr << "Failed to write logs to " << path << "\n";
+    return false;
+  }
+  export_path = path;
+  json_lines = ends_with(path, ".jsonl");
+  if (!json_lines) {
+    export_file << "{";
+    if (!suite_name.is_null())
+      export_file << "\"test_suite_name\":" << suite_name.dump() << ",";
+    export_file << "\"results\":[\n";
+  }
+  return true;
+}
+
+void ResultSink::add(const std::string &name,
+                     const test_runner::TestExecutionResult &result,
+                     const std::string &log) {
+  TRACE_SPAN("collect");
+  std::unique_lock<std::mutex> lock(mtx, std::defer_lock);
+  {
+    TRACE_SPAN("collect_lock_wait");
+    lock.lock();
+  }
+  if (result.failed)
+    ++fail_count;
+  else
+    ++pass_count;
+
+  if (!log.empty()) {
+    clear_progress();
+    console << log;
+    console.flush();
+  }
+
+  if (export_file.is_open()) {
+    nlohmann::json entry = {{"test_name", name},
+                            {"status", result.failed ? "failed" : "passed"},
+                            {"api_time_ms", result.api_time_ms},
+                            {"test_time_ms", result.test_time_ms},
+                            {"phases_us", result.phases},
+                            {"log", log}};
+    if (!result.diff.empty())
+      entry["diff"] = result.diff;
+    if (!result.samples_ms.empty())
+      entry["samples_ms"] = result.samples_ms;
+
+    if (!json_lines && !first_record)
+      export_file << ",\n";
+    export_file << entry.dump();
+    if (json_lines)
+      export_file << "\n";
+    export_file.flush();
+    first_record = false;
+  }
+
+  // Printing a log cleared the line, so it has to come back right away
+  draw_progress(!log.empty());
+}
+
+void ResultSink::finish() {
+  std::lock_guard<std::mutex> lock(mtx);
+  if (finished)
+    return;
+  finished = true;
+  clear_progress();
+
+  if (export_file.is_open()) {
+    if (!json_lines)
+      export_file << "\n]}\n";
+    export_file.close();
+    if (export_file)
+      console << "\nExported logs to " << export_path << "\n";
+    else
+      std::cerr << "Failed to write logs to " << export_path << "\n";
+  }
+}
+
+void ResultSink::add_total(size_t more) {
+  std::lock_guard<std::mutex> lock(mtx);
+  total += more;
+  progress = total > 1 && isatty(STDERR_FILENO);
+}
+
+void ResultSink::clear_progress() {
+  if (progress)
+    std::cerr << "\r\033[K" << std::flush;
+}
+
+// [ 120/2000] 118 passed | 2 failed | 35.4 tests/s
+void ResultSink::draw_progress(bool force) {
+  if (!progress)
+    return;
+  auto now = std::chrono::steady_clock::now();
+  size_t done = static_cast<size_t>(pass_count + fail_count);
+  if (done >= total) {
+    // Everything is in; leave the terminal to the summary
+    clear_progress();
+    return;
+  }
+  if (!force && now - last_draw < kRedrawInterval)
+    return;
+  last_draw = now;
+
+  double seconds = std::chrono::duration<double>(now - start).count();
+  char line[128];
+  std::snprintf(line, sizeof(line),
+                "\r\033[K[%5zu/%zu] %d passed | %d failed | %.1f tests/s", done,
+                total, pass_count, fail_count,
+                seconds > 0 ? static_cast<double>(done) / seconds : 0.0);
+  std::cerr << line << std::flush;
+}
+
+bool read_export(const std::string &path,
+                 const std::function<void(const nlohmann::json &)> &fn,
+                 nlohmann::json *suite_name) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    std::cerr << "Failed to read " << path << "\n";
+    return false;
+  }
+
+  try {
+    if (ends_with(path, ".jsonl")) {
+      std::string line;
+      while (std::getline(in, line)) {
+        if (line.find_first_not_of(" \t\r") != std::string::npos)
+          fn(nlohmann::json::parse(line));
+      }
+      return true;
+    }
+
+    nlohmann::json doc = nlohmann::json::parse(in);
+    if (!doc.contains("results") || !doc["results"].is_array()) {
+      std::cerr << path << " has no 'results' array\n";
+      return false;
+    }
+    if (suite_name && doc.contains("test_suite_name"))
+      *suite_name = doc["test_suite_name"];
+    for (const auto &record : doc["results"])
+      fn(record);
+  } catch (const std::exception &e) {
+    std::cerr << "Failed to read " << path << " (" << e.what() << ")\n";
+    return false;
+  }
+  return true;
+}
+
+bool merge_exports(const std::vector<std::string> &inputs,
+                   const std::string &out_path) {
+  struct Totals {
+    int passed = 0;
+    int failed = 0;
+    long long api_time_ms = 0;
+    long long test_time_ms = 0;
+
+    void add(const nlohmann::json &record) {
+      if (record.value("status", "") == "failed")
+        ++failed;
+      else
+        ++passed;
+      api_time_ms += record.value("api_time_ms", 0LL);
+      test_time_ms += record.value("test_time_ms", 0LL);
+    }
+  };
+
+  // Written next to `out_path` and moved over it once complete, so an input
+  // that fails to read leaves no truncated report behind
+  std::string tmpPath = out_path + ".tmp";
+  std::ofstream out(tmpPath);
+  if (!out.is_open()) {
+    std::cerr << "Failed to write " << tmpPath << "\n";
+    return false;
+  }
+  auto discard = [&] {
+    out.close();
+    std::remove(tmpPath.c_str());
+    return false;
+  };
+  bool jsonLines = ends_with(out_path, ".jsonl");
+
+  nlohmann::json suiteName;
+  nlohmann::json shards = nlohmann::json::array();
+  Totals overall;
+  bool first = true;
+
+  // The suite name is only known once the first input is read, so it goes
+  // after the results
+  if (!jsonLines)
+    out << "{\"results\":[\n";
+
+  for (const auto &path : inputs) {
+    Totals shard;
+    bool ok = read_export(
+        path,
+        [&](const nlohmann::json &record) {
+          if (!record.is_object())
+            return;
+          shard.add(record);
+          overall.add(record);
+          if (!jsonLines && !first)
+            out << ",\n";
+          out << record.dump();
+          if (jsonLines)
+            out << "\n";
+          first = false;
+        },
+        suiteName.is_null() ? &suiteName : nullptr);
+    if (!ok)
+      return discard();
+
+    std::cout << path << ": " << shard.passed << " passed | " << shard.failed
+              << " failed | api " << shard.api_time_ms << " ms | test "
+              << shard.test_time_ms << " ms\n";
+    shards.push_back({{"file", path},
+                      {"passed", shard.passed},
+                      {"failed", shard.failed},
+                      {"api_time_ms", shard.api_time_ms},
+                      {"test_time_ms", shard.test_time_ms}});
+  }
+
+  if (!jsonLines) {
+    nlohmann::json summary = {{"passed", overall.passed},
+                              {"failed", overall.failed},
+                              {"api_time_ms", overall.api_time_ms},
+                              {"test_time_ms", overall.test_time_ms},
+                              {"shards", shards}};
+    out << "\n]";
+    if (!suiteName.is_null())
+      out << ",\"test_suite_name\":" << suiteName.dump();
+    out << ",\"summary\":" << summary.dump() << "}\n";
+  }
+  out.close();
+  if (!out || std::rename(tmpPath.c_str(), out_path.c_str()) != 0) {
+    std::cerr << "Failed to write " << out_path << "\n";
+    return discard();
+  }
+
+  std::cout << "\nPassed: " << overall.passed << " | Failed: " << overall.failed
+            << "\nTotal api time: " << overall.api_time_ms
+            << " ms | Total test time: " << overall.test_time_ms << " ms\n"
+            << "Merged " << inputs.size() << " logs into " << out_path << "\n";
+  return true;
+}
+
+} // namespace result_sink
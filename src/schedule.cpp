@@ -0,0 +1,175 @@
+#include "schedule.hpp"
+#include "result_sink.hpp"
+#include "test_graph.hpp"
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+namespace schedule {
+
+namespace {
+
+// Expected duration of every case; unknown ones get the median of the
+// known timings.
+std::vector<double> estimates(const nlohmann::json &test_cases,
+                              const History &history, size_t &known) {
+  size_t count = test_cases.size();
+  std::vector<double> estimate(count, -1);
+  std::vector<double> timings;
+
+  for (size_t i = 0; i < count; ++i) {
+    const auto &testCase = test_cases[i];
+    if (!testCase.contains("test_name") || !testCase["test_name"].is_string())
+      continue;
+    auto it = history.find(testCase["test_name"].get<std::string>());
+    if (it == history.end())
+      continue;
+    estimate[i] = it->second;
+    timings.push_back(it->second);
+  }
+  known = timings.size();
+
+  double median = 0;
+  if (!timings.empty()) {
+    auto mid = timings.begin() + timings.size() / 2;
+    std::nth_element(timings.begin(), mid, timings.end());
+    median = *mid;
+  }
+  for (double &ms : estimate) {
+    if (ms < 0)
+      ms = median;
+  }
+  return estimate;
+}
+
+// Sorts `cases` longest-expected-first, keeping the given order among ties.
+void longest_first(std::vector<size_t> &cases,
+                   const std::vector<double> &estimate) {
+  std::stable_sort(cases.begin(), cases.end(), [&](size_t a, size_t b) {
+    return estimate[a] > estimate[b];
+  });
+}
+
+} // namespace
+
+bool load_history(const std::string &path, History &out) {
+  struct Timing {
+    double total_ms = 0;
+    size_t samples = 0;
+  };
+  std::unordered_map<std::string, Timing> timings;
+
+  bool ok = result_sink::read_export(path, [&](const nlohmann::json &record) {
+    if (!record.is_object() || !record.contains("test_name") ||
+        !record["test_name"].is_string() || !record.contains("test_time_ms") ||
+        !record["test_time_ms"].is_number())
+      return;
+    Timing &timing = timings[record["test_name"].get<std::string>()];
+    timing.total_ms += record["test_time_ms"].get<double>();
+    ++timing.samples;
+  });
+  if (!ok)
+    return false;
+
+  for (const auto &[name, timing] : timings)
+    out[name] = timing.total_ms / static_cast<double>(timing.samples);
+  return true;
+}
+
+bool parse_shard(const std::string &spec, size_t &index, size_t &count) {
+  size_t slash = spec.find('/');
+  if (slash == std::string::npos)
+    return false;
+  try {
+    size_t pos = 0;
+    unsigned long i = std::stoul(spec.substr(0, slash), &pos);
+    if (pos != slash)
+      return false;
+    std::string total = spec.substr(slash + 1);
+    unsigned long n = std::stoul(total, &pos);
+    if (pos != total.size() || n == 0 || i == 0 || i > n)
+      return false;
+    index = i - 1;
+    count = n;
+  } catch (const std::exception &) {
+    return false;
+  }
+  return true;
+}
+
+std::vector<size_t> shard(const nlohmann::json &test_cases,
+                          const History *history, size_t index, size_t count) {
+  size_t caseCount = test_cases.size();
+
+  // A chain is dealt as one unit, named by its first case, so it never
+  // spans shards
+  std::vector<size_t> chain = test_graph::components(test_cases);
+  std::vector<size_t> units;
+  for (size_t i = 0; i < caseCount; ++i)
+    if (chain[i] == i)
+      units.push_back(i);
+
+  std::vector<bool> taken(caseCount, false); // by unit
+  if (!history) {
+    for (size_t u = index; u < units.size(); u += count)
+      taken[units[u]] = true;
+  } else {
+    size_t known = 0;
+    std::vector<double> estimate = estimates(test_cases, *history, known);
+    std::vector<double> weight(caseCount, 0);
+    for (size_t i = 0; i < caseCount; ++i)
+      weight[chain[i]] += estimate[i];
+    longest_first(units, weight);
+
+    // Linear scan for the lightest shard: the lowest index wins ties, which
+    // keeps the split identical on every machine
+    std::vector<double> load(count, 0);
+    for (size_t unit : units) {
+      size_t lightest = 0;
+      for (size_t s = 1; s < count; ++s) {
+        if (load[s] < load[lightest])
+          lightest = s;
+      }
+      load[lightest] += weight[unit];
+      if (lightest == index)
+        taken[unit] = true;
+    }
+  }
+
+  std::vector<size_t> mine;
+  for (size_t i = 0; i < caseCount; ++i)
+    if (taken[chain[i]])
+      mine.push_back(i);
+  return mine;
+}
+
+Plan plan(const nlohmann::json &test_cases, const std::vector<size_t> &cases,
+          const History &history, size_t workers) {
+  Plan result;
+  size_t known = 0;
+  std::vector<double> estimate = estimates(test_cases, history, known);
+  for (size_t i : cases) {
+    const auto &testCase = test_cases[i];
+    if (testCase.contains("test_name") && testCase["test_name"].is_string() &&
+        history.count(testCase["test_name"].get<std::string>()))
+      ++result.known;
+  }
+
+  result.order = cases;
+  longest_first(result.order, estimate);
+
+  // Finish times of the busy slots; each case goes to the earliest free one
+  std::priority_queue<double, std::vector<double>, std::greater<double>> slots;
+  for (size_t i = 0; i < std::max<size_t>(workers, 1) && i < cases.size(); ++i)
+    slots.push(0);
+  for (size_t index : result.order) {
+    double start = slots.top();
+    slots.pop();
+    double end = start + estimate[index];
+    slots.push(end);
+    result.predicted_ms = std::max(result.predicted_ms, end);
+  }
+  return result;
+}
+
+} // namespace schedule
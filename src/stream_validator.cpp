@@ -0,0 +1,648 @@
+#include "stream_validator.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <unordered_map>
+
+namespace stream_validator {
+
+namespace {
+
+bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// One step of a diff path: an object key, or an array element ranked by
+// when its array first reported it.
+struct Step {
+  bool element;
+  std::string key;
+  size_t rank;
+  bool operator<(const Step &other) const {
+    if (element != other.element)
+      return element;
+    return element ? rank < other.rank : key < other.key;
+  }
+};
+
+// Element ranks handed out so far, keyed by the path up to and including
+// the index.
+struct Ranks {
+  std::unordered_map<std::string, size_t> elements;
+  size_t next = 0;
+};
+
+// "a.b[2].c" -> a, b, [2], c. An element the path ends at gets a rank of
+// its own: an added and a removed element may share an index without
+// being reported next to each other.
+std::vector<Step> split_path(const std::string &path, Ranks &ranks) {
+  std::vector<Step> steps;
+  size_t pos = 0;
+  while (pos < path.size()) {
+    if (path[pos] == '[') {
+      size_t close = path.find(']', pos);
+      if (close != std::string::npos) {
+        size_t rank = ranks.next;
+        if (close + 1 < path.size())
+          rank = ranks.elements.emplace(path.substr(0, close + 1), rank)
+                     .first->second;
+        if (rank == ranks.next)
+          ++ranks.next;
+        steps.push_back({true, std::string(), rank});
+        pos = close + 1;
+        continue;
+      }
+    }
+    if (path[pos] == '.')
+      ++pos;
+    size_t end = path.find_first_of(".[", pos);
+    if (end == std::string::npos)
+      end = path.size();
+    steps.push_back({false, path.substr(pos, end - pos), 0});
+    pos = end;
+  }
+  return steps;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+bool valid_number(const std::string &s) {
+  size_t i = 0, n = s.size();
+  if (i < n && s[i] == '-')
+    ++i;
+  if (i >= n || !is_digit(s[i]))
+    return false;
+  if (s[i] == '0') {
+    ++i;
+  } else {
+    while (i < n && is_digit(s[i]))
+      ++i;
+  }
+  if (i < n && s[i] == '.') {
+    size_t start = ++i;
+    while (i < n && is_digit(s[i]))
+      ++i;
+    if (i == start)
+      return false;
+  }
+  if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+    ++i;
+    if (i < n && (s[i] == '+' || s[i] == '-'))
+      ++i;
+    size_t start = i;
+    while (i < n && is_digit(s[i]))
+      ++i;
+    if (i == start)
+      return false;
+  }
+  return i == n;
+}
+
+bool is_number_char(char c) {
+  return is_digit(c) || c == '-' || c == '+' || c == '.' || c == 'e' ||
+         c == 'E';
+}
+
+} // namespace
+
+StreamValidator::StreamValidator(const nlohmann::json &expected,
+                                 const json_utils::DiffFilter &filter,
+                                 bool fail_fast)
+    : expected(expected), filter(filter), fail_fast(fail_fast) {
+  path.reserve(128);
+}
+
+bool StreamValidator::feed(const char *data, size_t len) {
+  size_t i = 0;
+  while (i < len && !stop) {
+    // Plain string content is copied in runs rather than char by char
+    if (token == Token::String && !escape && unicode_digits < 0 &&
+        !high_surrogate) {
+      size_t run = i;
+      while (run < len && data[run] != '"' && data[run] != '\\' &&
+             static_cast<unsigned char>(data[run]) >= 0x20)
+        ++run;
+      text.append(data + i, run - i);
+      offset_in_body += run - i;
+      i = run;
+      if (i == len)
+        break;
+    }
+    if (lex(data[i])) {
+      ++i;
+      ++offset_in_body;
+    }
+  }
+  return !stop;
+}
+
+void StreamValidator::finish() {
+  if (!stop) {
+    if (token == Token::Number || token == Token::Literal)
+      end_token();
+    if (!stop && (token != Token::None || expect != Expect::Done))
+      fail("unexpected end of the body");
+  }
+  sort_diffs();
+}
+
+// Members are reported in the order they arrive, diff_collect visits them
+// in sorted key order. Elements of one array are reported together and in
+// diff_collect's order already, so they keep the order they came in.
+void StreamValidator::sort_diffs() {
+  if (found.size() < 2)
+    return;
+  Ranks ranks;
+  std::vector<std::pair<std::vector<Step>, size_t>> order;
+  order.reserve(found.size());
+  for (size_t i = 0; i < found.size(); ++i)
+    order.emplace_back(split_path(found[i].path, ranks), i);
+  std::stable_sort(
+      order.begin(), order.end(),
+      [](const auto &a, const auto &b) { return a.first < b.first; });
+
+  json_utils::DiffList sorted;
+  sorted.reserve(found.size());
+  for (const auto &entry : order)
+    sorted.push_back(std::move(found[entry.second]));
+  found = std::move(sorted);
+}
+
+void StreamValidator::fail(const std::string &message) {
+  if (stop)
+    return;
+  syntax_error =
+      "invalid JSON at byte " + std::to_string(offset_in_body) + ": " + message;
+  stop = true;
+}
+
+void StreamValidator::value_done() {
+  expect = nesting.empty() ? Expect::Done : Expect::CommaOrEnd;
+}
+
+bool StreamValidator::value_allowed() const {
+  return expect == Expect::Value || expect == Expect::ValueOrEnd;
+}
+
+// Returns false when `c` ended a number or literal and has to be looked at
+// again as the start of the next token.
+bool StreamValidator::lex(char c) {
+  switch (token) {
+  case Token::String:
+    if (unicode_digits > 0) {
+      int digit = std::isxdigit(static_cast<unsigned char>(c))
+                      ? (is_digit(c) ? c - '0' : (std::tolower(c) - 'a' + 10))
+                      : -1;
+      if (digit < 0) {
+        fail("invalid \\u escape");
+        return true;
+      }
+      unicode_value = unicode_value * 16 + static_cast<unsigned>(digit);
+      if (--unicode_digits == 0) {
+        unicode_digits = -1;
+        append_codepoint();
+      }
+    } else if (escape) {
+      escape = false;
+      if (high_surrogate && c != 'u') {
+        fail("unpaired surrogate");
+        return true;
+      }
+      switch (c) {
+      case '"':
+      case '\\':
+      case '/':
+        text += c;
+        break;
+      case 'b':
+        text += '\b';
+        break;
+      case 'f':
+        text += '\f';
+        break;
+      case 'n':
+        text += '\n';
+        break;
+      case 'r':
+        text += '\r';
+        break;
+      case 't':
+        text += '\t';
+        break;
+      case 'u':
+        unicode_digits = 4;
+        unicode_value = 0;
+        break;
+      default:
+        fail("invalid escape");
+      }
+    } else if (c == '\\') {
+      escape = true;
+    } else if (high_surrogate) {
+      fail("unpaired surrogate");
+    } else if (c == '"') {
+      token = Token::None;
+      if (token_is_key) {
+        key(std::move(text));
+        expect = Expect::Colon;
+      } else {
+        scalar(nlohmann::json(std::move(text)));
+        value_done();
+      }
+      text.clear();
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      fail("control character in string");
+    } else {
+      text += c;
+    }
+    return true;
+
+  case Token::Number:
+    if (is_number_char(c)) {
+      text += c;
+      return true;
+    }
+    end_token();
+    return stop;
+
+  case Token::Literal:
+    if (std::isalpha(static_cast<unsigned char>(c))) {
+      text += c;
+      return true;
+    }
+    end_token();
+    return stop;
+
+  case Token::None:
+    break;
+  }
+
+  if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+    return true;
+  if (expect == Expect::Done) {
+    fail("unexpected data after the document");
+    return true;
+  }
+
+  switch (c) {
+  case '{':
+  case '[':
+    if (!value_allowed()) {
+      fail(std::string("unexpected '") + c + "'");
+      break;
+    }
+    nesting.push_back(c);
+    begin_container(c == '{');
+    expect = c == '{' ? Expect::KeyOrEnd : Expect::ValueOrEnd;
+    break;
+  case '}':
+  case ']': {
+    char open = c == '}' ? '{' : '[';
+    bool empty = expect == (c == '}' ? Expect::KeyOrEnd : Expect::ValueOrEnd);
+    if (!empty &&
+        !(expect == Expect::CommaOrEnd && nesting.back() == open)) {
+      fail(std::string("unexpected '") + c + "'");
+      break;
+    }
+    nesting.pop_back();
+    end_container();
+    value_done();
+    break;
+  }
+  case ',':
+    if (expect != Expect::CommaOrEnd) {
+      fail("unexpected ','");
+      break;
+    }
+    expect = nesting.back() == '{' ? Expect::Key : Expect::Value;
+    break;
+  case ':':
+    if (expect != Expect::Colon) {
+      fail("unexpected ':'");
+      break;
+    }
+    expect = Expect::Value;
+    break;
+  case '"':
+    if (expect == Expect::Key || expect == Expect::KeyOrEnd) {
+      token_is_key = true;
+    } else if (value_allowed()) {
+      token_is_key = false;
+    } else {
+      fail("unexpected string");
+      break;
+    }
+    token = Token::String;
+    break;
+  default:
+    if (value_allowed() && (c == '-' || is_digit(c))) {
+      token = Token::Number;
+      text = c;
+    } else if (value_allowed() && std::isalpha(static_cast<unsigned char>(c))) {
+      token = Token::Literal;
+      text = c;
+    } else {
+      fail(std::string("unexpected character '") + c + "'");
+    }
+  }
+  return true;
+}
+
+void StreamValidator::append_codepoint() {
+  unsigned cp = unicode_value;
+  if (high_surrogate) {
+    if (cp < 0xDC00 || cp > 0xDFFF) {
+      fail("unpaired surrogate");
+      return;
+    }
+    cp = 0x10000 + ((high_surrogate - 0xD800) << 10) + (cp - 0xDC00);
+    high_surrogate = 0;
+  } else if (cp >= 0xD800 && cp <= 0xDBFF) {
+    high_surrogate = cp; // the low half follows as another \u escape
+    return;
+  } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+    fail("unpaired surrogate");
+    return;
+  }
+
+  if (cp < 0x80) {
+    text += static_cast<char>(cp);
+  } else if (cp < 0x800) {
+    text += static_cast<char>(0xC0 | (cp >> 6));
+    text += static_cast<char>(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    text += static_cast<char>(0xE0 | (cp >> 12));
+    text += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    text += static_cast<char>(0x80 | (cp & 0x3F));
+  } else {
+    text += static_cast<char>(0xF0 | (cp >> 18));
+    text += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+    text += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+    text += static_cast<char>(0x80 | (cp & 0x3F));
+  }
+}
+
+void StreamValidator::end_token() {
+  bool ok = token == Token::Number ? end_number() : end_literal();
+  token = Token::None;
+  text.clear();
+  if (ok)
+    value_done();
+}
+
+// Same number types as nlohmann's parser: unsigned for non-negative
+// integers, signed for negative ones, double for fractions, exponents and
+// integers that do not fit.
+bool StreamValidator::end_number() {
+  if (!valid_number(text)) {
+    fail("invalid number '" + text + "'");
+    return false;
+  }
+  if (text.find_first_of(".eE") == std::string::npos) {
+    errno = 0;
+    if (text[0] == '-') {
+      long long value = std::strtoll(text.c_str(), nullptr, 10);
+      if (errno != ERANGE) {
+        scalar(nlohmann::json(value));
+        return true;
+      }
+    } else {
+      unsigned long long value = std::strtoull(text.c_str(), nullptr, 10);
+      if (errno != ERANGE) {
+        scalar(nlohmann::json(value));
+        return true;
+      }
+    }
+  }
+  scalar(nlohmann::json(std::strtod(text.c_str(), nullptr)));
+  return true;
+}
+
+bool StreamValidator::end_literal() {
+  if (text == "true") {
+    scalar(nlohmann::json(true));
+  } else if (text == "false") {
+    scalar(nlohmann::json(false));
+  } else if (text == "null") {
+    scalar(nlohmann::json(nullptr));
+  } else {
+    fail("invalid literal '" + text + "'");
+    return false;
+  }
+  return true;
+}
+
+void StreamValidator::set_path(const Frame &frame, const std::string &key) {
+  path.resize(frame.path_mark);
+  if (!path.empty())
+    path += '.';
+  path += key;
+}
+
+void StreamValidator::set_path(const Frame &frame, size_t index) {
+  path.resize(frame.path_mark);
+  path += '[';
+  path += std::to_string(index);
+  path += ']';
+}
+
+StreamValidator::Slot StreamValidator::next_slot() {
+  if (frames.empty())
+    return {&expected, filter.root(), false};
+  Frame &frame = frames.back();
+  if (frame.is_object)
+    return frame.member;
+  set_path(frame, frame.index);
+  Slot slot;
+  slot.element = true;
+  return slot;
+}
+
+void StreamValidator::begin_container(bool is_object) {
+  if (skip_depth > 0) {
+    ++skip_depth;
+    return;
+  }
+  nlohmann::json empty =
+      is_object ? nlohmann::json::object() : nlohmann::json::array();
+  if (capturing) {
+    capture_value(std::move(empty), true);
+    return;
+  }
+
+  Slot slot = next_slot();
+  if (!slot.element) {
+    if (filter.pruned(slot.cursor)) {
+      skip_depth = 1;
+      return;
+    }
+    if (slot.expected && (is_object ? slot.expected->is_object()
+                                    : slot.expected->is_array())) {
+      Frame frame;
+      frame.is_object = is_object;
+      frame.expected = slot.expected;
+      frame.cursor = slot.cursor;
+      frame.path_mark = path.size();
+      if (!is_object && filter.array_key(slot.cursor)) {
+        frame.buffering = true; // keyed matching needs the whole array
+        frame.tail = nlohmann::json::array();
+      } else if (!is_object) {
+        frame.positional = fail_fast && filter.position_independent();
+      }
+      frames.push_back(std::move(frame));
+      return;
+    }
+  }
+
+  // Compared as a whole once complete
+  capturing = true;
+  capture_slot = slot;
+  captured = std::move(empty);
+  capture_stack.assign(1, &captured);
+}
+
+void StreamValidator::capture_value(nlohmann::json &&value, bool container) {
+  nlohmann::json *parent = capture_stack.back();
+  nlohmann::json *slot;
+  if (parent->is_object()) {
+    slot = &((*parent)[capture_key] = std::move(value));
+  } else {
+    parent->push_back(std::move(value));
+    slot = &parent->back();
+  }
+  if (container)
+    capture_stack.push_back(slot);
+}
+
+void StreamValidator::end_container() {
+  if (skip_depth > 0) {
+    --skip_depth;
+    return;
+  }
+  if (capturing) {
+    capture_stack.pop_back();
+    if (capture_stack.empty()) {
+      capturing = false;
+      resolve(capture_slot, std::move(captured));
+    }
+    return;
+  }
+
+  Frame frame = std::move(frames.back());
+  frames.pop_back();
+  path.resize(frame.path_mark);
+  if (frame.is_object)
+    close_object(frame);
+  else
+    close_array(frame);
+  check_stop();
+}
+
+void StreamValidator::key(std::string &&name) {
+  if (skip_depth > 0)
+    return;
+  if (capturing) {
+    capture_key = std::move(name);
+    return;
+  }
+
+  Frame &frame = frames.back();
+  set_path(frame, name);
+  auto it = frame.expected->find(name);
+  frame.member.expected = it != frame.expected->end() ? &*it : nullptr;
+  frame.member.cursor = filter.step(frame.cursor, name);
+  if (frame.seen.insert(std::move(name)).second && frame.member.expected)
+    ++frame.matched;
+}
+
+void StreamValidator::scalar(nlohmann::json &&value) {
+  if (skip_depth > 0)
+    return;
+  if (capturing) {
+    capture_value(std::move(value), false);
+    return;
+  }
+  resolve(next_slot(), std::move(value));
+}
+
+void StreamValidator::resolve(const Slot &slot, nlohmann::json &&value) {
+  if (slot.element)
+    resolve_element(frames.back(), std::move(value));
+  else
+    record(slot.expected, std::move(value), slot.cursor);
+}
+
+void StreamValidator::resolve_element(Frame &frame, nlohmann::json &&value) {
+  size_t index = frame.index++;
+  if (frame.buffering) {
+    frame.tail.push_back(std::move(value));
+    return;
+  }
+
+  const nlohmann::json *eVal =
+      index < frame.expected->size() ? &(*frame.expected)[index] : nullptr;
+  if (eVal && *eVal == value) {
+    frame.offset = frame.index;
+    return;
+  }
+  if (frame.positional) {
+    record(eVal, std::move(value), filter.step(frame.cursor, index));
+    return;
+  }
+  frame.buffering = true;
+  frame.tail = nlohmann::json::array();
+  frame.tail.push_back(std::move(value));
+}
+
+void StreamValidator::close_object(Frame &frame) {
+  if (frame.matched == frame.expected->size())
+    return;
+  // Expected members that never arrived
+  for (auto it = frame.expected->begin(); it != frame.expected->end(); ++it) {
+    if (frame.seen.count(it.key()))
+      continue;
+    set_path(frame, it.key());
+    json_utils::diff_collect_at(&it.value(), nullptr, filter,
+                                filter.step(frame.cursor, it.key()), path,
+                                found);
+  }
+  path.resize(frame.path_mark);
+}
+
+void StreamValidator::close_array(Frame &frame) {
+  if (frame.buffering) {
+    owned.push_back(std::move(frame.tail));
+    if (!json_utils::diff_collect_elements(*frame.expected, owned.back(),
+                                           frame.offset, filter, frame.cursor,
+                                           path, found))
+      owned.pop_back();
+    return;
+  }
+
+  // Every element so far matched; expected elements that never arrived
+  for (size_t i = frame.index; i < frame.expected->size(); ++i) {
+    set_path(frame, i);
+    json_utils::diff_collect_at(&(*frame.expected)[i], nullptr, filter,
+                                filter.step(frame.cursor, i), path, found);
+    if (fail_fast && !found.empty())
+      break;
+  }
+  path.resize(frame.path_mark);
+}
+
+void StreamValidator::record(const nlohmann::json *expected,
+                             nlohmann::json &&actual,
+                             const json_utils::DiffFilter::Cursor &cursor) {
+  if (expected && *expected == actual)
+    return;
+  owned.push_back(std::move(actual));
+  if (!json_utils::diff_collect_at(expected, &owned.back(), filter, cursor,
+                                   path, found))
+    owned.pop_back();
+  check_stop();
+}
+
+void StreamValidator::check_stop() {
+  if (fail_fast && !found.empty())
+    stop = true;
+}
+
+} // namespace stream_validator
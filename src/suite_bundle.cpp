@@ -0,0 +1,168 @@
+#include "suite_bundle.hpp"
+#include "json_utils.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace suite_bundle {
+
+namespace {
+
+constexpr char kMagic[8] = {'P', 'I', 'N', 'G', 'U', 'B', 'N', 1};
+constexpr size_t kHeaderSize = 24;
+
+void put_u64(std::string &out, uint64_t value) {
+  for (int i = 0; i < 8; ++i)
+    out += static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+uint64_t get_u64(const char *data) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; --i)
+    value = (value << 8) | static_cast<unsigned char>(data[i]);
+  return value;
+}
+
+// Fixture paths a suite case refers to. A path filled in per row of a
+// parameter table ("expected/{{id}}.json") names no single file, so those
+// fixtures stay on disk.
+std::vector<std::string> fixture_paths(const nlohmann::json &testCase) {
+  std::vector<std::string> paths;
+  for (const char *field : {"request_description", "expected_response"}) {
+    if (testCase.contains(field) && testCase[field].is_string() &&
+        !json_utils::has_placeholders(testCase[field]))
+      paths.push_back(testCase[field].get<std::string>());
+  }
+  return paths;
+}
+
+} // namespace
+
+bool compile(const std::string &suite_path, const std::string &out_path) {
+  nlohmann::json suite;
+  if (!json_utils::read_json(suite_path, suite)) {
+    std::cerr << "Failed to read JSON from " << suite_path << "\n";
+    return false;
+  }
+  if (!suite.contains("test_cases") || !suite["test_cases"].is_array()) {
+    std::cerr << "Invalid test suite: missing or invalid 'test_cases' array\n";
+    return false;
+  }
+
+  std::string body;
+  nlohmann::json index = nlohmann::json::object();
+  std::unordered_map<std::string, uint64_t> stored; // encoded bytes -> offset
+  size_t unique = 0;
+
+  for (const auto &testCase : suite["test_cases"]) {
+    for (const auto &path : fixture_paths(testCase)) {
+      if (index.contains(path))
+        continue;
+      nlohmann::json fixture;
+      if (!json_utils::read_json(path, fixture)) {
+        std::cerr << "Failed to read JSON from " << path << "\n";
+        return false;
+      }
+
+      std::vector<uint8_t> cbor = nlohmann::json::to_cbor(fixture);
+      std::string bytes(cbor.begin(), cbor.end());
+      auto [it, inserted] =
+          stored.emplace(std::move(bytes), kHeaderSize + body.size());
+      if (inserted) {
+        body += it->first;
+        ++unique;
+      }
+      index[path] = {it->second, it->first.size()};
+    }
+  }
+
+  std::vector<uint8_t> encodedIndex =
+      nlohmann::json::to_cbor({{"suite", suite}, {"fixtures", index}});
+
+  std::string header(kMagic, sizeof(kMagic));
+  put_u64(header, kHeaderSize + body.size());
+  put_u64(header, encodedIndex.size());
+
+  std::ofstream out(out_path, std::ios::binary);
+  if (!out.is_open()) {
+    std::cerr << "Failed to write " << out_path << "\n";
+    return false;
+  }
+  out.write(header.data(), header.size());
+  out.write(body.data(), body.size());
+  out.write(reinterpret_cast<const char *>(encodedIndex.data()),
+            encodedIndex.size());
+  if (!out) {
+    std::cerr << "Failed to write " << out_path << "\n";
+    return false;
+  }
+
+  std::cout << "Compiled " << suite["test_cases"].size() << " cases, "
+            << index.size() << " fixtures (" << unique << " unique) into "
+            << out_path << " ("
+            << (header.size() + body.size() + encodedIndex.size()) / 1024
+            << " KiB)\n";
+  return true;
+}
+
+bool is_bundle(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(kMagic)] = {};
+  in.read(magic, sizeof(magic));
+  return in && std::memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+std::shared_ptr<const Bundle> Bundle::open(const std::string &path) {
+  auto bundle = std::make_shared<Bundle>(path);
+  const mapped_file::MappedFile &file = bundle->file;
+  if (!file.ok || file.size < kHeaderSize ||
+      std::memcmp(file.data, kMagic, sizeof(kMagic)) != 0) {
+    std::cerr << path << " is not a Pingu bundle\n";
+    return nullptr;
+  }
+
+  uint64_t indexOffset = get_u64(file.data + 8);
+  uint64_t indexSize = get_u64(file.data + 16);
+  if (indexOffset < kHeaderSize || indexOffset > file.size ||
+      indexSize > file.size - indexOffset) {
+    std::cerr << path << " is truncated\n";
+    return nullptr;
+  }
+
+  try {
+    nlohmann::json index = decode(file.data + indexOffset, indexSize);
+    bundle->suite_spec = std::move(index.at("suite"));
+    for (const auto &[fixture, blob] : index.at("fixtures").items()) {
+      uint64_t offset = blob.at(0).get<uint64_t>();
+      uint64_t size = blob.at(1).get<uint64_t>();
+      if (offset < kHeaderSize || offset > indexOffset ||
+          size > indexOffset - offset) {
+        std::cerr << path << ": fixture " << fixture << " is out of bounds\n";
+        return nullptr;
+      }
+      bundle->fixtures.emplace(fixture, Blob{offset, size});
+    }
+  } catch (const std::exception &e) {
+    std::cerr << path << ": invalid bundle index (" << e.what() << ")\n";
+    return nullptr;
+  }
+  return bundle;
+}
+
+bool Bundle::find(const std::string &path, const char *&data,
+                  size_t &size) const {
+  auto it = fixtures.find(path);
+  if (it == fixtures.end())
+    return false;
+  data = file.data + it->second.offset;
+  size = static_cast<size_t>(it->second.size);
+  return true;
+}
+
+nlohmann::json Bundle::decode(const char *data, size_t size) {
+  const auto *bytes = reinterpret_cast<const uint8_t *>(data);
+  return nlohmann::json::from_cbor(bytes, bytes + size);
+}
+
+} // namespace suite_bundle
@@ -0,0 +1,258 @@
+#include "test_graph.hpp"
+#include <algorithm>
+
+namespace test_graph {
+
+namespace {
+
+std::string case_name(const nlohmann::json &testCase) {
+  const auto it = testCase.find("test_name");
+  if (it == testCase.end())
+    return std::string();
+  return it->is_string() ? it->get<std::string>() : it->dump();
+}
+
+// Calls fn(case, dependency) for every "depends_on" name that resolves to
+// a case (the first of that name). Bad names are left to Graph::build.
+template <typename Fn>
+void for_each_edge(const nlohmann::json &test_cases, Fn &&fn) {
+  std::unordered_map<std::string, size_t> by_name;
+  for (size_t i = 0; i < test_cases.size(); ++i)
+    by_name.emplace(case_name(test_cases[i]), i);
+
+  for (size_t i = 0; i < test_cases.size(); ++i) {
+    if (!test_cases[i].contains("depends_on"))
+      continue;
+    nlohmann::json deps = test_cases[i]["depends_on"];
+    if (deps.is_string())
+      deps = nlohmann::json::array({deps});
+    if (!deps.is_array())
+      continue;
+    for (const auto &dep : deps) {
+      auto it = by_name.find(dep.is_string() ? dep.get<std::string>()
+                                             : dep.dump());
+      if (it != by_name.end())
+        fn(i, it->second);
+    }
+  }
+}
+
+} // namespace
+
+bool is_chained(const nlohmann::json &test_cases) {
+  for (const auto &testCase : test_cases) {
+    if (testCase.contains("depends_on") || testCase.contains("extract"))
+      return true;
+  }
+  return false;
+}
+
+std::vector<size_t> components(const nlohmann::json &test_cases) {
+  // Union-find, the smaller index always becoming the root
+  std::vector<size_t> root(test_cases.size());
+  for (size_t i = 0; i < root.size(); ++i)
+    root[i] = i;
+  auto find = [&root](size_t i) {
+    while (root[i] != i)
+      i = root[i] = root[root[i]];
+    return i;
+  };
+  for_each_edge(test_cases, [&](size_t child, size_t parent) {
+    size_t a = find(child), b = find(parent);
+    root[std::max(a, b)] = std::min(a, b);
+  });
+  for (size_t i = 0; i < root.size(); ++i)
+    root[i] = find(i);
+  return root;
+}
+
+std::vector<size_t> related(const nlohmann::json &test_cases,
+                            const std::vector<size_t> &cases) {
+  std::vector<std::vector<size_t>> parents(test_cases.size());
+  std::vector<std::vector<size_t>> children(test_cases.size());
+  for_each_edge(test_cases, [&](size_t child, size_t parent) {
+    parents[child].push_back(parent);
+    children[parent].push_back(child);
+  });
+
+  std::vector<bool> picked(test_cases.size(), false);
+  auto walk = [&picked](std::vector<size_t> pending,
+                        const std::vector<std::vector<size_t>> &edges) {
+    while (!pending.empty()) {
+      size_t index = pending.back();
+      pending.pop_back();
+      for (size_t next : edges[index]) {
+        if (!picked[next]) {
+          picked[next] = true;
+          pending.push_back(next);
+        }
+      }
+    }
+  };
+
+  for (size_t index : cases)
+    picked[index] = true;
+  walk(cases, children);
+  std::vector<size_t> downstream;
+  for (size_t i = 0; i < picked.size(); ++i)
+    if (picked[i])
+      downstream.push_back(i);
+  walk(downstream, parents);
+
+  std::vector<size_t> result;
+  for (size_t i = 0; i < picked.size(); ++i)
+    if (picked[i])
+      result.push_back(i);
+  return result;
+}
+
+bool Graph::build(const nlohmann::json &test_cases,
+                  const std::vector<size_t> &cases, std::string &error) {
+  // Names are looked up in the whole suite, so a dependency that exists but
+  // was left out of this run gets a clearer message than "unknown"
+  std::unordered_map<std::string, size_t> by_name;
+  std::unordered_map<std::string, size_t> duplicates;
+  for (size_t i = 0; i < test_cases.size(); ++i) {
+    std::string name = case_name(test_cases[i]);
+    if (!by_name.emplace(name, i).second)
+      ++duplicates[name];
+  }
+
+  order = cases;
+  nodes.clear();
+  for (size_t index : cases)
+    nodes[index].name = case_name(test_cases[index]);
+
+  for (size_t index : cases) {
+    const nlohmann::json &testCase = test_cases[index];
+    // Its rows are separate cases made up while the run goes
+    if (testCase.contains("parameters") &&
+        (testCase.contains("depends_on") || testCase.contains("extract"))) {
+      error = "\"" + nodes[index].name +
+              "\": a case with 'parameters' cannot use 'depends_on' or "
+              "'extract'";
+      return false;
+    }
+    if (!testCase.contains("depends_on"))
+      continue;
+    nlohmann::json deps = testCase["depends_on"];
+    if (deps.is_string())
+      deps = nlohmann::json::array({deps});
+
+    Node &node = nodes[index];
+    if (!deps.is_array()) {
+      error = "\"" + node.name + "\": 'depends_on' must be a name or a list "
+                                 "of names";
+      return false;
+    }
+    for (const auto &dep : deps) {
+      std::string name = dep.is_string() ? dep.get<std::string>() : dep.dump();
+      auto it = by_name.find(name);
+      if (it == by_name.end()) {
+        error = "\"" + node.name + "\" depends on unknown case \"" + name +
+                "\"";
+        return false;
+      }
+      if (duplicates.count(name)) {
+        error = "\"" + node.name + "\" depends on \"" + name +
+                "\", which names more than one case";
+        return false;
+      }
+      if (test_cases[it->second].contains("parameters")) {
+        error = "\"" + node.name + "\" depends on \"" + name +
+                "\", which has 'parameters'";
+        return false;
+      }
+      auto parent = nodes.find(it->second);
+      if (parent == nodes.end()) {
+        error = "\"" + node.name + "\" depends on \"" + name +
+                "\", which is not part of this run";
+        return false;
+      }
+      node.parents.push_back(it->second);
+      parent->second.children.push_back(index);
+    }
+    node.waiting = node.parents.size();
+  }
+
+  // Kahn's algorithm: whatever never becomes ready sits on a cycle
+  std::unordered_map<size_t, size_t> waiting;
+  std::vector<size_t> ready;
+  for (size_t index : cases) {
+    waiting[index] = nodes[index].waiting;
+    if (waiting[index] == 0)
+      ready.push_back(index);
+  }
+  size_t visited = 0;
+  while (!ready.empty()) {
+    size_t index = ready.back();
+    ready.pop_back();
+    ++visited;
+    for (size_t child : nodes[index].children) {
+      if (--waiting[child] == 0)
+        ready.push_back(child);
+    }
+  }
+  if (visited < cases.size()) {
+    for (size_t index : cases) {
+      if (waiting[index] > 0) {
+        error = "\"" + nodes[index].name + "\" is part of a dependency cycle";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+std::vector<size_t> Graph::roots() const {
+  std::vector<size_t> result;
+  for (size_t index : order) {
+    if (nodes.at(index).parents.empty())
+      result.push_back(index);
+  }
+  return result;
+}
+
+Release Graph::finish(size_t index, bool passed,
+                      const nlohmann::json &extracted) {
+  std::lock_guard<std::mutex> lock(mtx);
+  Node &node = nodes.at(index);
+  node.passed = passed;
+  if (extracted.is_object())
+    node.scope.update(extracted);
+
+  Release out;
+  release(index, out);
+  return out;
+}
+
+// Counts `index` as finished for each of its children. A child whose last
+// parent just finished either becomes ready or, below a failure, is skipped
+// and released in turn.
+void Graph::release(size_t index, Release &out) {
+  const Node &node = nodes.at(index);
+  for (size_t childIndex : node.children) {
+    Node &child = nodes.at(childIndex);
+    if (!node.passed && child.failed_dep.empty())
+      child.failed_dep = node.failed_dep.empty() ? node.name : node.failed_dep;
+    if (--child.waiting > 0)
+      continue;
+
+    if (!child.failed_dep.empty()) {
+      child.passed = false;
+      out.skipped.emplace_back(childIndex, child.failed_dep);
+      release(childIndex, out);
+      continue;
+    }
+    for (size_t parent : child.parents)
+      child.scope.update(nodes.at(parent).scope);
+    out.ready.push_back(childIndex);
+  }
+}
+
+nlohmann::json Graph::variables(size_t index) const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return nodes.at(index).scope;
+}
+
+} // namespace test_graph
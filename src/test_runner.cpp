@@ -1,51 +1,194 @@
+#include "test_runner.hpp"
 #include "http_utils.hpp"
 #include "json_utils.hpp"
 #include "log_utils.hpp"
+#include "stream_validator.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <string>
-#include <unordered_set>
+#include <vector>
 
 namespace test_runner {
 
-struct TestExecutionResult {
-  bool failed;
-  int api_time_ms;
-  int test_time_ms;
+namespace {
+
+// Fixtures are shared, read-only documents (see fixture_cache.hpp).
+struct PreparedTest {
+  fixture_cache::Document request_desc;
+  fixture_cache::Document expected_response;
+  json_utils::DiffFilter filter;
+  LatencyBudget budget;
+  int runs = 1;           // "repeat"
+  std::string spec_error; // malformed spec or unfilled placeholder; no run
 };
 
-TestExecutionResult run_test(const nlohmann::json &testSpec,
-                             const bool printCompact, int verbosity,
-                             std::stringstream &logOut) {
-  std::string requestJSON = testSpec["request_description"];
-  std::string responseJSON = testSpec["expected_response"];
+// What the runs of one test have added up to so far.
+struct RunTally {
+  int done = 0;
+  int failed_runs = 0;
+  bool responded = false; // some run got an answer from the server
+  bool logged = false;    // a failing run's output is in the log
+  long long api_total_ms = 0;
+  std::vector<int> api_ms;
+  std::vector<double> samples_ms;
+};
 
-  nlohmann::json request_desc, response, expected_response;
-  json_utils::read_json(requestJSON, request_desc);
-  json_utils::read_json(responseJSON, expected_response);
+int elapsed_ms(std::chrono::high_resolution_clock::time_point from,
+               std::chrono::high_resolution_clock::time_point to) {
+  return static_cast<int>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(to - from)
+          .count());
+}
 
-  std::unordered_set<std::string> ignoreKeys;
-  if (testSpec.contains("ignore") && testSpec["ignore"].is_array()) {
-    for (const auto &item : testSpec["ignore"]) {
-      ignoreKeys.insert(item.get<std::string>());
-    }
+// A missing or unparsable fixture reads as null, like before the cache.
+fixture_cache::Document load_fixture(const std::string &path,
+                                     fixture_cache::FixtureCache *fixtures) {
+  static const fixture_cache::Document null_document =
+      std::make_shared<const nlohmann::json>();
+  TRACE_SPAN("fixture_load");
+
+  fixture_cache::Document doc;
+  if (fixtures) {
+    doc = fixtures->load(path);
+  } else {
+    auto parsed = std::make_shared<nlohmann::json>();
+    if (json_utils::read_json(path, *parsed))
+      doc = std::move(parsed);
   }
+  return doc ? doc : null_document;
+}
 
-  std::unordered_set<std::string> watchKeys;
-  if (testSpec.contains("watch") && testSpec["watch"].is_array()) {
-    for (const auto &item : testSpec["watch"]) {
-      watchKeys.insert(item.get<std::string>());
-    }
+// Fixtures without placeholders stay shared; the others are filled in for
+// this test only, from a template compiled once per fixture.
+void fill_placeholders(fixture_cache::Document &doc,
+                       const nlohmann::json &variables,
+                       fixture_cache::FixtureCache *fixtures,
+                       std::string &error) {
+  if (!error.empty())
+    return;
+  auto compiled = fixtures ? fixtures->template_for(doc)
+                           : std::make_shared<const json_utils::Template>(doc);
+  if (compiled->empty())
+    return;
+  auto filled = std::make_shared<nlohmann::json>();
+  if (compiled->fill(variables, *filled, error))
+    doc = std::move(filled);
+}
+
+// The fixture file named by `field`. Sets `error` (unless already set)
+// when the field is not a path.
+std::string fixture_path(const nlohmann::json &testSpec, const char *field,
+                         std::string &error) {
+  auto it = testSpec.find(field);
+  if (it != testSpec.end() && it->is_string())
+    return it->get<std::string>();
+  if (error.empty())
+    error = std::string("'") + field + "' must be the path of a JSON file";
+  return std::string();
+}
+
+// The cache for the fixture named by `field`, or null for a path a row
+// filled in: it names another file per row, and cached they would all stay
+// in memory until the run ends.
+fixture_cache::FixtureCache *fixtures_for(const RunOptions &options,
+                                          const char *field) {
+  if (options.source) {
+    auto it = options.source->find(field);
+    if (it != options.source->end() && json_utils::has_placeholders(*it))
+      return nullptr;
   }
+  return options.fixtures;
+}
 
-  bool test_failed = false;
+// The path patterns listed under `field` ("ignore", "watch").
+std::vector<std::string> pattern_list(const nlohmann::json &testSpec,
+                                      const char *field, std::string &error) {
+  std::vector<std::string> patterns;
+  auto it = testSpec.find(field);
+  if (it == testSpec.end() || !it->is_array())
+    return patterns;
+  for (const auto &item : *it) {
+    if (item.is_string())
+      patterns.push_back(item.get<std::string>());
+    else if (error.empty())
+      error = std::string("'") + field + "' entries must be strings";
+  }
+  return patterns;
+}
 
-  auto test_start = std::chrono::high_resolution_clock::now();
+// A malformed field leaves `test.spec_error` set rather than throwing, so
+// the case is reported as failed and its dependents are skipped.
+void load_test(const nlohmann::json &testSpec, const RunOptions &options,
+               PreparedTest &test) {
+  std::string requestJSON =
+      fixture_path(testSpec, "request_description", test.spec_error);
+  std::string responseJSON =
+      fixture_path(testSpec, "expected_response", test.spec_error);
+  if (!test.spec_error.empty())
+    return;
 
+  auto *requestFixtures = fixtures_for(options, "request_description");
+  auto *responseFixtures = fixtures_for(options, "expected_response");
+  test.request_desc = load_fixture(requestJSON, requestFixtures);
+  test.expected_response = load_fixture(responseJSON, responseFixtures);
+  if (options.variables) {
+    fill_placeholders(test.request_desc, *options.variables, requestFixtures,
+                      test.spec_error);
+    fill_placeholders(test.expected_response, *options.variables,
+                      responseFixtures, test.spec_error);
+  }
+
+  test.budget = options.budget;
+  parse_budget(testSpec, test.budget, test.spec_error);
+  if (testSpec.contains("repeat")) {
+    const auto &repeat = testSpec["repeat"];
+    if (repeat.is_number_integer() && repeat.get<int>() >= 1)
+      test.runs = repeat.get<int>();
+    else
+      test.spec_error = "'repeat' must be a positive integer";
+  }
+  if (testSpec.contains("stream") && !testSpec["stream"].is_boolean())
+    test.spec_error = "'stream' must be true or false";
+
+  std::vector<std::string> ignoreKeys =
+      pattern_list(testSpec, "ignore", test.spec_error);
+  std::vector<std::string> watchKeys =
+      pattern_list(testSpec, "watch", test.spec_error);
+
+  // Compiled once per test, then stepped along with the diff traversal
+  test.filter = json_utils::DiffFilter(ignoreKeys, watchKeys);
+
+  // "array_key": "id" keys every array, {"items": "id"} only matching paths
+  if (testSpec.contains("array_key")) {
+    const auto &arrayKey = testSpec["array_key"];
+    if (arrayKey.is_string()) {
+      test.filter.add_array_key("**", arrayKey.get<std::string>());
+    } else if (arrayKey.is_object()) {
+      for (const auto &[pattern, field] : arrayKey.items()) {
+        if (field.is_string())
+          test.filter.add_array_key(pattern, field.get<std::string>());
+        else
+          test.spec_error = "'array_key' fields must be strings";
+      }
+    } else {
+      test.spec_error = "'array_key' must be a field name or an object of "
+                        "path patterns to field names";
+    }
+  }
+}
+
+void log_header(const nlohmann::json &testSpec, int verbosity,
+                std::stringstream &logOut) {
+  TRACE_SPAN("render");
   if (verbosity > 0) {
     logOut << "\n────────────────────────────────────────────────────\n";
     logOut << "[Test] \"" << testSpec["test_name"] << "\"\n";
@@ -53,53 +196,486 @@ TestExecutionResult run_test(const nlohmann::json &testSpec,
       logOut << "🔹 " << testSpec["test_description"] << "\n";
     }
   }
+}
 
-  auto api_start = std::chrono::high_resolution_clock::now();
-  bool api_success = http_utils::make_request_from_json(request_desc, response);
-  auto api_end = std::chrono::high_resolution_clock::now();
-  int api_time_ms =
-      std::chrono::duration_cast<std::chrono::milliseconds>(api_end - api_start)
-          .count();
+long long elapsed_us(std::chrono::high_resolution_clock::time_point from) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::high_resolution_clock::now() - from)
+      .count();
+}
 
-  if (api_success) {
-    // Redirect std::cout to logOut
-    std::streambuf *original_buf = std::cout.rdbuf();
-    std::cout.rdbuf(logOut.rdbuf());
+void log_verdict(const nlohmann::json &testSpec, bool test_failed,
+                 std::stringstream &logOut) {
+  if (test_failed) {
+    logOut << COLOR_RED << "Test \"" << testSpec["test_name"] << "\" Failed"
+           << COLOR_RESET << "\n";
+  } else {
+    logOut << COLOR_GREEN << "Test \"" << testSpec["test_name"]
+           << "\" Successful" << COLOR_RESET << "\n";
+  }
+}
 
-    if (printCompact) {
-      test_failed = json_utils::diff_json_compact(expected_response, response,
-                                                  "", ignoreKeys, watchKeys);
-    } else {
-      test_failed = json_utils::diff_json(expected_response, response, "",
-                                          ignoreKeys, watchKeys, 2, 0);
-    }
+// Streaming needs a document to walk; a plain-text expectation is compared
+// against the buffered body as before.
+bool use_streaming(const nlohmann::json &testSpec, const PreparedTest &test,
+                   const RunOptions &options) {
+  return (options.stream || testSpec.value("stream", false)) &&
+         test.expected_response->is_structured() &&
+         !testSpec.contains("extract");
+}
 
-    // Restore std::cout
-    std::cout.rdbuf(original_buf);
+// Diffs the response against the expectation and logs the differences.
+// Returns true when the run failed.
+bool check_response(const PreparedTest &test, bool api_success,
+                    const nlohmann::json &response, bool printCompact,
+                    std::stringstream &logOut, TestExecutionResult &result) {
+  bool test_failed = false;
+
+  if (api_success) {
+    auto diff_start = std::chrono::high_resolution_clock::now();
+    json_utils::DiffList diffs;
+    {
+      TRACE_SPAN("diff");
+      test_failed = json_utils::diff_collect(*test.expected_response, response,
+                                             test.filter, diffs);
+    }
+    result.phases.diff_us = elapsed_us(diff_start);
 
+    // Formatting is only paid for when something differs
     if (test_failed) {
-      logOut << COLOR_RED << "Test \"" << testSpec["test_name"] << "\" Failed"
-             << COLOR_RESET << "\n";
-    } else {
-      logOut << COLOR_GREEN << "Test \"" << testSpec["test_name"]
-             << "\" Successful" << COLOR_RESET << "\n";
+      TRACE_SPAN("render");
+      if (printCompact) {
+        json_utils::render_diff_compact(diffs, logOut);
+      } else {
+        json_utils::render_diff(*test.expected_response, response,
+                                test.filter, diffs, logOut, 2);
+      }
+      result.diff = json_utils::diff_to_json(diffs);
     }
   } else {
     test_failed = true;
     logOut << COLOR_RED << "API Request Failed" << COLOR_RESET << "\n";
   }
 
-  auto test_end = std::chrono::high_resolution_clock::now();
-  int test_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                         test_end - test_start)
-                         .count();
+  return test_failed;
+}
+
+// Stores the "extract" values of a response. Returns true when one of them
+// is missing, which fails the run.
+bool extract_values(const nlohmann::json &testSpec,
+                    const nlohmann::json &response, std::stringstream &logOut,
+                    TestExecutionResult &result) {
+  if (!testSpec.contains("extract") || !testSpec["extract"].is_object())
+    return false;
+  bool missing = false;
+  for (const auto &[name, path] : testSpec["extract"].items()) {
+    std::string where = path.is_string() ? path.get<std::string>() : "";
+    const nlohmann::json *value = json_utils::find_path(response, where);
+    if (!path.is_string() || !value) {
+      logOut << COLOR_RED << "Cannot extract " << name << ": no value at "
+             << path.dump() << COLOR_RESET << "\n";
+      missing = true;
+      continue;
+    }
+    result.extracted[name] = *value;
+  }
+  return missing;
+}
 
-  logOut << COLOR_BLUE << "\nAPI Time: " << api_time_ms << " ms\n"
+// Same as check_response for a body that was validated while it streamed.
+bool check_streamed(bool api_success,
+                    stream_validator::StreamValidator &validator,
+                    std::stringstream &logOut, TestExecutionResult &result) {
+  if (!api_success) {
+    logOut << COLOR_RED << "API Request Failed" << COLOR_RESET << "\n";
+    return true;
+  }
+
+  auto diff_start = std::chrono::high_resolution_clock::now();
+  {
+    TRACE_SPAN("diff");
+    validator.finish();
+  }
+  result.phases.diff_us = elapsed_us(diff_start);
+  TRACE_SPAN("render");
+
+  bool test_failed = false;
+  if (!validator.error().empty()) {
+    test_failed = true;
+    logOut << COLOR_RED << "Response is not valid JSON (" << validator.error()
+           << ")" << COLOR_RESET << "\n";
+  } else if (!validator.diffs().empty()) {
+    test_failed = true;
+    json_utils::render_diff_compact(validator.diffs(), logOut);
+    result.diff = json_utils::diff_to_json(validator.diffs());
+    if (validator.stopped())
+      logOut << "Transfer aborted at the first difference\n";
+  }
+  return test_failed;
+}
+
+std::string format_ms(double ms) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.1f", ms);
+  return text;
+}
+
+// Nearest-rank percentile of sorted samples.
+double percentile(const std::vector<double> &sorted, double p) {
+  size_t rank = static_cast<size_t>(
+      std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+  return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+// Folds one run into the tally. Only the first failing run is logged, so a
+// flaky endpoint repeated a hundred times does not print a hundred diffs.
+void record_run(bool api_success, TestExecutionResult &run,
+                std::stringstream &runLog, RunTally &tally,
+                TestExecutionResult &result, std::stringstream &logOut) {
+  ++tally.done;
+  tally.api_ms.push_back(run.api_time_ms);
+  tally.api_total_ms += run.api_time_ms;
+  if (api_success) {
+    tally.responded = true;
+    tally.samples_ms.push_back(static_cast<double>(run.phases.total_us) /
+                               1000.0);
+  }
+  if (run.failed) {
+    ++tally.failed_runs;
+    if (!tally.logged) {
+      logOut << runLog.str();
+      result.diff = std::move(run.diff);
+      tally.logged = true;
+    }
+  }
+  result.phases = run.phases;
+  if (!run.extracted.is_null())
+    result.extracted = std::move(run.extracted);
+}
+
+// Judges the test on all of its runs and logs the verdict, which is left
+// out when no run got as far as a response.
+void finish_test(const nlohmann::json &testSpec, const PreparedTest &test,
+                 RunTally &tally, TestExecutionResult &result,
+                 std::stringstream &logOut) {
+  TRACE_SPAN("render");
+  result.failed = tally.failed_runs > 0;
+
+  std::vector<int> &api = tally.api_ms;
+  if (!api.empty()) {
+    std::nth_element(api.begin(), api.begin() + api.size() / 2, api.end());
+    result.api_time_ms = api[api.size() / 2];
+  }
+
+  if (test.runs > 1) {
+    if (tally.failed_runs > 0) {
+      logOut << COLOR_RED << tally.failed_runs << " of " << tally.done
+             << " runs failed" << COLOR_RESET << "\n";
+    }
+    if (tally.done < test.runs && test.spec_error.empty()) {
+      logOut << COLOR_RED << "Cancelled after " << tally.done << " of "
+             << test.runs << " runs" << COLOR_RESET << "\n";
+      result.failed = true;
+    }
+    if (!tally.samples_ms.empty()) {
+      std::vector<double> sorted = tally.samples_ms;
+      std::sort(sorted.begin(), sorted.end());
+      logOut << COLOR_BLUE << "Latency over " << sorted.size()
+             << " runs (ms): min " << format_ms(sorted.front()) << " | p50 "
+             << format_ms(percentile(sorted, 50)) << " | p95 "
+             << format_ms(percentile(sorted, 95)) << " | max "
+             << format_ms(sorted.back()) << COLOR_RESET << "\n";
+    }
+    result.samples_ms = tally.samples_ms;
+  }
+
+  if (!test.spec_error.empty()) {
+    logOut << COLOR_RED << "Invalid test spec: " << test.spec_error
+           << COLOR_RESET << "\n";
+    result.failed = true;
+  } else if (check_budget(test.budget, tally.samples_ms, logOut)) {
+    result.failed = true;
+  }
+
+  if (tally.responded || !test.spec_error.empty())
+    log_verdict(testSpec, result.failed, logOut);
+}
+
+void log_timings(const TestExecutionResult &result, int verbosity,
+                 std::stringstream &logOut) {
+  TRACE_SPAN("render");
+  logOut << COLOR_BLUE << "\nAPI Time: " << result.api_time_ms << " ms\n"
          << COLOR_RESET;
-  logOut << COLOR_BLUE << "Total Test Time: " << test_time_ms << " ms\n"
+  logOut << COLOR_BLUE << "Total Test Time: " << result.test_time_ms
+         << " ms\n"
          << COLOR_RESET;
 
-  return {test_failed, api_time_ms, test_time_ms};
+  if (verbosity > 1) {
+    const auto &p = result.phases;
+    logOut << COLOR_BLUE << "Phases (us): dns " << p.dns_us << " | connect "
+           << p.connect_us << " | tls " << p.tls_us << " | ttfb " << p.ttfb_us
+           << " | transfer " << p.transfer_us << " | parse " << p.parse_us
+           << " | diff " << p.diff_us << "\n"
+           << COLOR_RESET;
+  }
+}
+
+// A test in flight on the async engine. Every completed run submits the
+// next one until all "repeat" runs are in.
+struct AsyncTest {
+  const nlohmann::json *spec = nullptr;
+  RunOptions options;
+  TestCallback done;
+  PreparedTest test;
+  RunTally tally;
+  TestExecutionResult result{};
+  std::stringstream logOut;
+  int local_time_ms = 0;
+  std::unique_ptr<stream_validator::StreamValidator> validator;
+  long long validate_us = 0;
+};
+
+// Reports the test once its last run is in.
+void complete_async(AsyncTest &state) {
+  auto finish_start = std::chrono::high_resolution_clock::now();
+  finish_test(*state.spec, state.test, state.tally, state.result,
+              state.logOut);
+  // Queueing time inside the engine is not charged to the test; its total
+  // is local work plus the time its transfers were actually on the wire.
+  state.result.test_time_ms =
+      state.local_time_ms + static_cast<int>(state.tally.api_total_ms) +
+      elapsed_ms(finish_start, std::chrono::high_resolution_clock::now());
+  log_timings(state.result, state.options.verbosity, state.logOut);
+
+  state.done(state.result, state.logOut);
+}
+
+void submit_run(const std::shared_ptr<AsyncTest> &state,
+                http_engine::Engine &engine) {
+  auto completion = [state, &engine](bool ok, nlohmann::json &response,
+                                     const http_utils::ResponseInfo &info) {
+    TRACE_SPAN("check");
+    auto check_start = std::chrono::high_resolution_clock::now();
+
+    TestExecutionResult run{};
+    std::stringstream runLog;
+    run.api_time_ms = info.api_time_ms;
+    run.phases = info.phases;
+    // A throw here would lose the test: the pool swallows it and the
+    // callback that records the result and releases dependents never runs
+    try {
+      if (state->validator) {
+        run.phases.parse_us = state->validate_us;
+        run.failed = check_streamed(ok, *state->validator, runLog, run);
+      } else {
+        run.failed = check_response(state->test, ok, response,
+                                    state->options.print_compact, runLog, run);
+        if (ok && extract_values(*state->spec, response, runLog, run))
+          run.failed = true;
+      }
+    } catch (const std::exception &e) {
+      runLog << COLOR_RED << "Invalid test spec: " << e.what() << COLOR_RESET
+             << "\n";
+      run.failed = true;
+    }
+    record_run(ok, run, runLog, state->tally, state->result, state->logOut);
+    state->local_time_ms +=
+        elapsed_ms(check_start, std::chrono::high_resolution_clock::now());
+
+    if (state->tally.done < state->test.runs && !http_utils::cancelled())
+      submit_run(state, engine);
+    else
+      complete_async(*state);
+  };
+
+  if (!use_streaming(*state->spec, state->test, state->options)) {
+    engine.submit(*state->test.request_desc, std::move(completion));
+    return;
+  }
+
+  // The sink runs on the engine's loop thread, the completion after it
+  state->validator = std::make_unique<stream_validator::StreamValidator>(
+      *state->test.expected_response, state->test.filter,
+      state->options.fail_fast);
+  state->validate_us = 0;
+  engine.submit(*state->test.request_desc, std::move(completion),
+                [state](const char *data, size_t len) {
+                  TRACE_SPAN("stream_validate");
+                  auto feed_start = std::chrono::high_resolution_clock::now();
+                  bool more = state->validator->feed(data, len);
+                  state->validate_us += elapsed_us(feed_start);
+                  return more;
+                });
+}
+
+} // namespace
+
+bool parse_budget(const nlohmann::json &spec, LatencyBudget &budget,
+                  std::string &error) {
+  if (spec.contains("max_latency_ms")) {
+    const auto &limit = spec["max_latency_ms"];
+    if (!limit.is_number() || limit.get<double>() <= 0) {
+      error = "'max_latency_ms' must be a positive number";
+      return false;
+    }
+    budget.max_ms = limit.get<double>();
+  }
+
+  if (spec.contains("latency_budget")) {
+    const auto &limits = spec["latency_budget"];
+    if (!limits.is_object()) {
+      error = "'latency_budget' must be an object such as {\"p95\": 250}";
+      return false;
+    }
+    budget.percentiles.clear();
+    for (const auto &[key, limit] : limits.items()) {
+      double p = 0;
+      size_t used = 0;
+      if (key.size() > 1 && key[0] == 'p') {
+        try {
+          p = std::stod(key.substr(1), &used);
+        } catch (...) {
+          used = 0;
+        }
+      }
+      if (used == 0 || used != key.size() - 1 || p <= 0 || p > 100 ||
+          !limit.is_number()) {
+        error = "invalid latency budget entry \"" + key +
+                "\" (expected \"p<percentile>\": <ms>)";
+        return false;
+      }
+      budget.percentiles.emplace_back(p, limit.get<double>());
+    }
+  }
+  return true;
+}
+
+bool check_budget(const LatencyBudget &budget, std::vector<double> samples,
+                  std::stringstream &logOut) {
+  if (samples.empty())
+    return false;
+  std::sort(samples.begin(), samples.end());
+
+  bool over = false;
+  if (budget.max_ms > 0 && samples.back() > budget.max_ms) {
+    logOut << COLOR_RED << "Latency budget exceeded: max "
+           << format_ms(samples.back()) << " ms > " << budget.max_ms << " ms"
+           << COLOR_RESET << "\n";
+    over = true;
+  }
+  for (const auto &[p, limit] : budget.percentiles) {
+    double value = percentile(samples, p);
+    if (value > limit) {
+      logOut << COLOR_RED << "Latency budget exceeded: p" << p << " "
+             << format_ms(value) << " ms > " << limit << " ms" << COLOR_RESET
+             << "\n";
+      over = true;
+    }
+  }
+  return over;
+}
+
+TestExecutionResult run_test(const nlohmann::json &testSpec,
+                             const RunOptions &options,
+                             std::stringstream &logOut) {
+  TRACE_SPAN("test");
+  PreparedTest test;
+  load_test(testSpec, options, test);
+
+  auto test_start = std::chrono::high_resolution_clock::now();
+
+  log_header(testSpec, options.verbosity, logOut);
+
+  TestExecutionResult result{};
+  RunTally tally;
+  int runs = test.spec_error.empty() ? test.runs : 0;
+  for (int i = 0; i < runs && (i == 0 || !http_utils::cancelled()); ++i) {
+    TestExecutionResult run{};
+    std::stringstream runLog;
+    http_utils::ResponseInfo info;
+    bool api_success = false;
+    auto api_start = std::chrono::high_resolution_clock::now();
+
+    if (use_streaming(testSpec, test, options)) {
+      // Validation runs inside the transfer and is reported as parse time
+      stream_validator::StreamValidator validator(
+          *test.expected_response, test.filter, options.fail_fast);
+      long long validate_us = 0;
+      api_success = http_utils::stream_request_from_json(
+          *test.request_desc,
+          [&](const char *data, size_t len) {
+            TRACE_SPAN("stream_validate");
+            auto feed_start = std::chrono::high_resolution_clock::now();
+            bool more = validator.feed(data, len);
+            validate_us += elapsed_us(feed_start);
+            return more;
+          },
+          &info);
+      run.api_time_ms =
+          elapsed_ms(api_start, std::chrono::high_resolution_clock::now());
+      run.phases = info.phases;
+      run.phases.parse_us = validate_us;
+      run.failed = check_streamed(api_success, validator, runLog, run);
+    } else {
+      nlohmann::json response;
+      api_success = http_utils::make_request_from_json(*test.request_desc,
+                                                       response, &info);
+      run.api_time_ms =
+          elapsed_ms(api_start, std::chrono::high_resolution_clock::now());
+      run.phases = info.phases;
+      run.failed = check_response(test, api_success, response,
+                                  options.print_compact, runLog, run);
+      if (api_success && extract_values(testSpec, response, runLog, run))
+        run.failed = true;
+    }
+    record_run(api_success, run, runLog, tally, result, logOut);
+  }
+  finish_test(testSpec, test, tally, result, logOut);
+
+  result.test_time_ms =
+      elapsed_ms(test_start, std::chrono::high_resolution_clock::now());
+  log_timings(result, options.verbosity, logOut);
+
+  return result;
+}
+
+void run_test_async(const nlohmann::json &testSpec, const RunOptions &options,
+                    http_engine::Engine &engine, TestCallback done) {
+  auto state = std::make_shared<AsyncTest>();
+  state->spec = &testSpec;
+  state->options = options;
+  state->done = std::move(done);
+
+  // Called from the engine's dispatcher (the main thread), where nothing
+  // would catch a throw: whatever a malformed spec raises fails the test
+  try {
+    load_test(testSpec, options, state->test);
+  } catch (const std::exception &e) {
+    state->test.spec_error = e.what();
+  }
+  // The variables are filled in by now and may not outlive this call
+  state->options.variables = nullptr;
+
+  auto prep_start = std::chrono::high_resolution_clock::now();
+  log_header(testSpec, options.verbosity, state->logOut);
+  state->local_time_ms =
+      elapsed_ms(prep_start, std::chrono::high_resolution_clock::now());
+
+  if (state->test.spec_error.empty())
+    submit_run(state, engine);
+  else
+    complete_async(*state);
+}
+
+TestExecutionResult skip_test(const nlohmann::json &testSpec,
+                              const std::string &reason,
+                              const RunOptions &options,
+                              std::stringstream &logOut) {
+  log_header(testSpec, options.verbosity, logOut);
+  logOut << COLOR_RED << "Skipped: " << reason << COLOR_RESET << "\n";
+  TestExecutionResult result{};
+  result.failed = true;
+  return result;
 }
 
 } // namespace test_runner
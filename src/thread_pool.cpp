@@ -0,0 +1,122 @@
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <exception>
+#include <iostream>
+#include <string>
+
+namespace thread_pool {
+
+// Identifies the pool and deque owned by the calling thread, if any.
+static thread_local const ThreadPool *current_pool = nullptr;
+static thread_local unsigned current_worker = 0;
+
+unsigned ThreadPool::default_workers() {
+  unsigned n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : n;
+}
+
+ThreadPool::ThreadPool(unsigned workers) {
+  if (workers == 0)
+    workers = default_workers();
+
+  for (unsigned i = 0; i < workers; ++i)
+    queues.push_back(std::make_unique<WorkQueue>());
+  for (unsigned i = 0; i < workers; ++i)
+    threads.emplace_back(&ThreadPool::worker_loop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(state_mtx);
+    stopping = true;
+  }
+  work_cv.notify_all();
+  for (auto &t : threads) {
+    if (t.joinable())
+      t.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  unsigned target;
+  if (current_pool == this) {
+    target = current_worker;
+  } else {
+    std::lock_guard<std::mutex> lock(state_mtx);
+    target = next_queue++ % queues.size();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(queues[target]->mtx);
+    queues[target]->tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard<std::mutex> lock(state_mtx);
+    ++queued;
+    ++pending;
+  }
+  work_cv.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+  std::unique_lock<std::mutex> lock(state_mtx);
+  idle_cv.wait(lock, [this] { return pending == 0; });
+}
+
+// Own deque is drained front-first so submission order is roughly kept;
+// thieves take from the back of their victim.
+bool ThreadPool::take_task(unsigned self, std::function<void()> &out) {
+  {
+    WorkQueue &own = *queues[self];
+    std::lock_guard<std::mutex> lock(own.mtx);
+    if (!own.tasks.empty()) {
+      out = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues.size(); ++i) {
+    WorkQueue &victim = *queues[(self + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mtx);
+    if (!victim.tasks.empty()) {
+      out = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::worker_loop(unsigned self) {
+  current_pool = this;
+  current_worker = self;
+  trace::set_thread_name("worker " + std::to_string(self));
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(state_mtx);
+      work_cv.wait(lock, [this] { return stopping || queued > 0; });
+      if (queued == 0)
+        return; // stopping with nothing left to run
+      --queued; // reserves one task that is already in some deque
+    }
+
+    std::function<void()> task;
+    while (!take_task(self, task))
+      std::this_thread::yield();
+
+    try {
+      task();
+    } catch (const std::exception &e) {
+      std::cerr << "Worker task failed: " << e.what() << "\n";
+    } catch (...) {
+      std::cerr << "Worker task failed with unknown error\n";
+    }
+
+    std::lock_guard<std::mutex> lock(state_mtx);
+    if (--pending == 0)
+      idle_cv.notify_all();
+  }
+}
+
+} // namespace thread_pool
@@ -0,0 +1,143 @@
+#include "trace.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <vector>
+
+namespace trace {
+
+namespace detail {
+std::atomic<bool> active{false};
+} // namespace detail
+
+namespace {
+
+struct Event {
+  const char *name;
+  int64_t start_ns;
+  int64_t end_ns;
+  uint64_t id; // 0 for spans on the thread's own track
+};
+
+struct Buffer {
+  int tid;
+  std::string thread_name;
+  std::vector<Event> events;
+};
+
+// Buffers outlive their threads so that pool workers that have already
+// exited still show up in the trace.
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<Buffer>> registry;
+std::chrono::steady_clock::time_point epoch;
+
+Buffer &local_buffer() {
+  thread_local Buffer *buffer = nullptr;
+  if (!buffer) {
+    auto owned = std::make_unique<Buffer>();
+    owned->events.reserve(4096);
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    owned->tid = static_cast<int>(registry.size()) + 1;
+    buffer = owned.get();
+    registry.push_back(std::move(owned));
+  }
+  return *buffer;
+}
+
+double to_us(int64_t ns) { return static_cast<double>(ns) / 1000.0; }
+
+} // namespace
+
+namespace detail {
+
+int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+void record(const char *name, int64_t start_ns, int64_t end_ns) {
+  local_buffer().events.push_back({name, start_ns, end_ns, 0});
+}
+
+} // namespace detail
+
+void start() {
+  epoch = std::chrono::steady_clock::now();
+  detail::active.store(true);
+  set_thread_name("main");
+}
+
+void set_thread_name(const std::string &name) {
+  if (enabled())
+    local_buffer().thread_name = name;
+}
+
+void record_async(const char *name, uint64_t id, int64_t start_ns,
+                  int64_t end_ns) {
+  if (enabled())
+    local_buffer().events.push_back({name, start_ns, end_ns, id});
+}
+
+bool write(const std::string &path) {
+  detail::active.store(false);
+
+  std::ofstream out(path);
+  if (!out.is_open()) {
+    std::cerr << "Failed to write trace to " << path << "\n";
+    return false;
+  }
+
+  // Written event by event; a long suite produces millions of them
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  size_t count = 0;
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  bool first = true;
+  auto emit = [&](const nlohmann::json &event) {
+    out << (first ? "" : ",\n") << event.dump();
+    first = false;
+  };
+
+  for (const auto &buffer : registry) {
+    if (!buffer->thread_name.empty())
+      emit({{"name", "thread_name"},
+            {"ph", "M"},
+            {"pid", 1},
+            {"tid", buffer->tid},
+            {"args", {{"name", buffer->thread_name}}}});
+
+    for (const Event &event : buffer->events) {
+      ++count;
+      if (event.id == 0) {
+        emit({{"name", event.name},
+              {"ph", "X"},
+              {"pid", 1},
+              {"tid", buffer->tid},
+              {"ts", to_us(event.start_ns)},
+              {"dur", to_us(event.end_ns - event.start_ns)}});
+        continue;
+      }
+      for (const char *phase : {"b", "e"})
+        emit({{"name", event.name},
+              {"cat", event.name},
+              {"ph", phase},
+              {"id", event.id},
+              {"pid", 1},
+              {"tid", buffer->tid},
+              {"ts", to_us(phase[0] == 'b' ? event.start_ns : event.end_ns)}});
+    }
+  }
+  out << "\n]}\n";
+  out.close();
+  if (!out) {
+    std::cerr << "Failed to write trace to " << path << "\n";
+    return false;
+  }
+  std::cout << "Wrote " << count << " trace events to " << path << "\n";
+  return true;
+}
+
+} // namespace trace
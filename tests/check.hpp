@@ -0,0 +1,54 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// A minimal test harness: TEST_CASE registers a function, CHECK records a
+// failed condition and carries on, and tests/main.cpp runs everything that
+// was registered (or the cases whose name contains its argument).
+namespace check {
+
+struct Case {
+  const char *name;
+  void (*fn)();
+};
+
+std::vector<Case> &registry();
+void fail(const char *file, int line, const std::string &what);
+
+struct Register {
+  Register(const char *name, void (*fn)()) { registry().push_back({name, fn}); }
+};
+
+} // namespace check
+
+#define TEST_CASE(name)                                                        \
+  static void name();                                                          \
+  static const check::Register name##_registered(#name, name);                 \
+  static void name()
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond))                                                               \
+      check::fail(__FILE__, __LINE__, #cond);                                  \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+  do {                                                                         \
+    if (!((a) == (b)))                                                         \
+      check::fail(__FILE__, __LINE__, #a " == " #b);                           \
+  } while (0)
+
+#define CHECK_NEAR(a, b, tolerance)                                            \
+  do {                                                                         \
+    double check_a = (a), check_b = (b);                                       \
+    if (!(std::fabs(check_a - check_b) <= (tolerance)))                        \
+      check::fail(__FILE__, __LINE__,                                          \
+                  #a " ~ " #b " (" + std::to_string(check_a) + " vs " +        \
+                      std::to_string(check_b) + ")");                          \
+  } while (0)
+
+#endif
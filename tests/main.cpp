@@ -0,0 +1,43 @@
+#include "check.hpp"
+#include <cstring>
+#include <exception>
+
+namespace check {
+
+namespace {
+
+int failures = 0;
+
+} // namespace
+
+std::vector<Case> &registry() {
+  static std::vector<Case> cases;
+  return cases;
+}
+
+void fail(const char *file, int line, const std::string &what) {
+  std::cerr << file << ":" << line << ": CHECK failed: " << what << "\n";
+  ++failures;
+}
+
+} // namespace check
+
+int main(int argc, char *argv[]) {
+  const char *filter = argc > 1 ? argv[1] : "";
+  size_t ran = 0;
+  for (const auto &testCase : check::registry()) {
+    if (std::strstr(testCase.name, filter) == nullptr)
+      continue;
+    ++ran;
+    int before = check::failures;
+    try {
+      testCase.fn();
+    } catch (const std::exception &e) {
+      check::fail(testCase.name, 0, std::string("threw ") + e.what());
+    }
+    std::cout << (check::failures == before ? "PASS " : "FAIL ")
+              << testCase.name << "\n";
+  }
+  std::cout << ran << " cases, " << check::failures << " failed checks\n";
+  return check::failures == 0 && ran > 0 ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+#include "check.hpp"
+#include "param_table.hpp"
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+
+namespace {
+
+using nlohmann::json;
+
+// A CSV file in the temporary directory, removed again at scope exit.
+struct TempCsv {
+  std::string path;
+  explicit TempCsv(const std::string &text)
+      : path((std::filesystem::temp_directory_path() /
+              ("pingu_tests_" + std::to_string(::getpid()) + ".csv"))
+                 .string()) {
+    std::ofstream(path, std::ios::binary) << text;
+  }
+  ~TempCsv() { std::filesystem::remove(path); }
+};
+
+// Every row of the table, and the reader's error (or the open error).
+std::vector<json> read_all(const std::string &text, std::string &error) {
+  TempCsv file(text);
+  std::vector<json> rows;
+  auto reader = param_table::Reader::open(file.path, error);
+  if (!reader)
+    return rows;
+  json row;
+  while (reader->next(row))
+    rows.push_back(row);
+  error = reader->error();
+  return rows;
+}
+
+std::vector<json> read_all(const std::string &text) {
+  std::string error;
+  auto rows = read_all(text, error);
+  CHECK_EQ(error, "");
+  return rows;
+}
+
+} // namespace
+
+TEST_CASE(csv_quoted_fields) {
+  auto rows = read_all("name,note\n"
+                       "\"a,b\",\"say \"\"hi\"\"\"\n"
+                       "plain,\n");
+  CHECK_EQ(rows.size(), 2u);
+  CHECK_EQ(rows[0], json({{"name", "a,b"}, {"note", "say \"hi\""}}));
+  CHECK_EQ(rows[1], json({{"name", "plain"}, {"note", ""}}));
+}
+
+TEST_CASE(csv_embedded_newlines) {
+  auto rows = read_all("id,text\r\n"
+                       "1,\"line one\r\nline two\r\n\"\r\n"
+                       "\r\n"
+                       "2,\"\"\r\n");
+  CHECK_EQ(rows.size(), 2u);
+  CHECK_EQ(rows[0], json({{"id", "1"}, {"text", "line one\nline two\n"}}));
+  CHECK_EQ(rows[1], json({{"id", "2"}, {"text", ""}}));
+}
+
+TEST_CASE(csv_header_byte_order_mark) {
+  auto rows = read_all("\xEF\xBB\xBFid,name\n7,x\n");
+  CHECK_EQ(rows.size(), 1u);
+  CHECK_EQ(rows[0], json({{"id", "7"}, {"name", "x"}}));
+}
+
+TEST_CASE(csv_malformed_rows) {
+  std::string error;
+  // The quoted field of the first row spans lines 2 and 3
+  auto rows = read_all("a,b\n1,\"x\ny\"\n1,2,3\n", error);
+  CHECK_EQ(rows.size(), 1u);
+  CHECK(error.find(".csv:4: expected 2 fields, found 3") != std::string::npos);
+
+  rows = read_all("a,b\n1,\"never closed\n", error);
+  CHECK(rows.empty());
+  CHECK(error.find("unterminated quoted field") != std::string::npos);
+
+  read_all("", error);
+  CHECK(error.find("missing the header line") != std::string::npos);
+}
@@ -0,0 +1,38 @@
+#include "check.hpp"
+#include "perf_compare.hpp"
+
+using perf_compare::min_p_value;
+using perf_compare::u_test_p_value;
+
+TEST_CASE(min_p_value_is_one_over_binomial) {
+  CHECK_NEAR(min_p_value(3, 3), 1.0 / 20, 1e-12);
+  CHECK_NEAR(min_p_value(5, 5), 1.0 / 252, 1e-12);
+  CHECK_NEAR(min_p_value(2, 5), 1.0 / 21, 1e-12);
+  CHECK_NEAR(min_p_value(5, 2), 1.0 / 21, 1e-12);
+  CHECK_NEAR(min_p_value(1, 1), 0.5, 1e-12);
+  CHECK_NEAR(min_p_value(0, 7), 1, 1e-12);
+}
+
+// Reference values: normal approximation with tie and continuity
+// correction, as scipy.stats.mannwhitneyu(current, baseline,
+// method="asymptotic") computes it.
+TEST_CASE(u_test_separated_samples) {
+  std::vector<double> low = {1, 2, 3, 4, 5}, high = {6, 7, 8, 9, 10};
+  CHECK_NEAR(u_test_p_value(low, high, true), 0.006092890177672409, 1e-9);
+  CHECK_NEAR(u_test_p_value(low, high, false), 0.9966923245172357, 1e-9);
+  CHECK_NEAR(u_test_p_value(high, low, false), 0.006092890177672409, 1e-9);
+}
+
+TEST_CASE(u_test_with_ties) {
+  CHECK_NEAR(u_test_p_value({1, 1, 2, 2}, {2, 2, 3, 3}, true),
+             0.04317936982350622, 1e-9);
+  CHECK_NEAR(u_test_p_value({10, 12, 11, 13, 15, 14, 9, 16},
+                            {14, 18, 17, 20, 19, 13, 21, 16}, true),
+             0.004252495328216079, 1e-9);
+}
+
+TEST_CASE(u_test_without_spread) {
+  // Every value tied: no evidence either way
+  CHECK_EQ(u_test_p_value({5, 5, 5}, {5, 5, 5}, true), 1.0);
+  CHECK_EQ(u_test_p_value({5, 5, 5}, {5, 5, 5}, false), 1.0);
+}
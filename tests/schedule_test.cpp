@@ -0,0 +1,45 @@
+#include "check.hpp"
+#include "schedule.hpp"
+
+namespace {
+
+using nlohmann::json;
+
+json named(const std::string &name, const json &depends_on = nullptr) {
+  json testCase = {{"test_name", name}};
+  if (!depends_on.is_null())
+    testCase["depends_on"] = depends_on;
+  return testCase;
+}
+
+} // namespace
+
+TEST_CASE(shard_round_robin_keeps_chains_together) {
+  // a -> b is one unit, c and d are units of their own
+  json cases = json::array(
+      {named("a"), named("b", "a"), named("c"), named("d")});
+  CHECK(schedule::shard(cases, nullptr, 0, 2) ==
+        std::vector<size_t>({0, 1, 3}));
+  CHECK(schedule::shard(cases, nullptr, 1, 2) == std::vector<size_t>({2}));
+}
+
+TEST_CASE(shard_by_history_weighs_whole_chains) {
+  // x -> y -> z (and w -> z) weighs 10 + 10 + 10 + 5 = 35, more than
+  // p and q together
+  json cases = json::array({named("p"), named("x"), named("y", "x"),
+                            named("q"), named("w"), named("z", {"y", "w"})});
+  schedule::History history = {{"p", 20}, {"x", 10}, {"y", 10},
+                               {"q", 12}, {"w", 5},  {"z", 10}};
+  CHECK(schedule::shard(cases, &history, 0, 2) ==
+        std::vector<size_t>({1, 2, 4, 5}));
+  CHECK(schedule::shard(cases, &history, 1, 2) == std::vector<size_t>({0, 3}));
+}
+
+TEST_CASE(shard_without_chains_is_unchanged) {
+  json cases = json::array({named("a"), named("b"), named("c")});
+  schedule::History history = {{"a", 1}, {"b", 5}, {"c", 3}};
+  CHECK(schedule::shard(cases, nullptr, 1, 2) == std::vector<size_t>({1}));
+  // b goes first to shard 1, c to shard 2, a to the lighter shard 2
+  CHECK(schedule::shard(cases, &history, 0, 2) == std::vector<size_t>({1}));
+  CHECK(schedule::shard(cases, &history, 1, 2) == std::vector<size_t>({0, 2}));
+}
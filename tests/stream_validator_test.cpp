@@ -0,0 +1,145 @@
+#include "check.hpp"
+#include "json_utils.hpp"
+#include "stream_validator.hpp"
+#include <random>
+
+namespace {
+
+using nlohmann::json;
+
+// "<kind> <path>" per difference, in the order reported.
+std::vector<std::string> describe(const json_utils::DiffList &diffs) {
+  std::vector<std::string> lines;
+  for (const auto &diff : diffs)
+    lines.push_back(std::to_string(static_cast<int>(diff.kind)) + " " +
+                    diff.path);
+  return lines;
+}
+
+std::vector<std::string> buffered(const json &expected, const json &actual,
+                                  const json_utils::DiffFilter &filter) {
+  json_utils::DiffList diffs;
+  json_utils::diff_collect(expected, actual, filter, diffs);
+  return describe(diffs);
+}
+
+// `body` fed `chunk` bytes at a time.
+std::vector<std::string> streamed(const json &expected, const std::string &body,
+                                  const json_utils::DiffFilter &filter,
+                                  size_t chunk) {
+  stream_validator::StreamValidator validator(expected, filter, false);
+  for (size_t pos = 0; pos < body.size(); pos += chunk)
+    validator.feed(body.data() + pos, std::min(chunk, body.size() - pos));
+  validator.finish();
+  CHECK(validator.error().empty());
+  return describe(validator.diffs());
+}
+
+void check_parity(const std::string &expected, const std::string &actual,
+                  const json_utils::DiffFilter &filter = {}) {
+  json e = json::parse(expected);
+  auto want = buffered(e, json::parse(actual), filter);
+  for (size_t chunk : {size_t(1), size_t(3), actual.size()})
+    CHECK(streamed(e, actual, filter, chunk) == want);
+}
+
+json random_value(std::mt19937 &rng, int depth) {
+  switch (rng() % (depth > 2 ? 3 : 5)) {
+  case 0:
+    return static_cast<int>(rng() % 4);
+  case 1:
+    return std::string(1, static_cast<char>('a' + rng() % 3));
+  case 2:
+    return nullptr;
+  case 3: {
+    json object = json::object();
+    for (size_t n = rng() % 5; n > 0; --n)
+      object[std::string(1, static_cast<char>('a' + rng() % 6))] =
+          random_value(rng, depth + 1);
+    return object;
+  }
+  default: {
+    json array = json::array();
+    for (size_t n = rng() % 6; n > 0; --n)
+      array.push_back(random_value(rng, depth + 1));
+    return array;
+  }
+  }
+}
+
+json mutated(json value, std::mt19937 &rng, int depth) {
+  if (rng() % 5 == 0)
+    return random_value(rng, depth);
+  if (value.is_object()) {
+    for (auto &member : value)
+      if (rng() % 2)
+        member = mutated(member, rng, depth + 1);
+    if (rng() % 3 == 0)
+      value[std::string(1, static_cast<char>('a' + rng() % 6))] =
+          random_value(rng, depth + 1);
+    if (rng() % 3 == 0 && !value.empty())
+      value.erase(value.begin());
+  } else if (value.is_array()) {
+    for (auto &element : value)
+      if (rng() % 2)
+        element = mutated(element, rng, depth + 1);
+    if (rng() % 3 == 0)
+      value.push_back(random_value(rng, depth + 1));
+    if (rng() % 3 == 0 && !value.empty())
+      value.erase(value.begin() + static_cast<long>(rng() % value.size()));
+  }
+  return value;
+}
+
+} // namespace
+
+TEST_CASE(stream_members_in_sorted_key_order) {
+  // Members arrive z, m, a but diff_collect visits a, b, m, z
+  check_parity(R"({"a":1,"b":2,"m":{"y":1,"x":2},"z":3})",
+               R"({"z":4,"m":{"y":0,"x":0},"a":5})");
+}
+
+TEST_CASE(stream_array_tail_alignment) {
+  check_parity(R"([1,2,3,4,5])", R"([1,2,9,4,5,6])");
+  check_parity(R"([{"a":1},{"a":2},{"a":3}])", R"([{"a":1},{"a":3}])");
+  // An added and a removed element reported at the same index
+  check_parity(R"([[[],"b",[3,null],null],2,[{"a":"a"},[],{"c":2}],"b","a"])",
+               R"(["c",3,"c",3,2])");
+}
+
+TEST_CASE(stream_keyed_arrays) {
+  json_utils::DiffFilter filter;
+  filter.add_array_key("items", "id");
+  check_parity(R"({"items":[{"id":1,"v":1},{"id":2,"v":2},{"id":3,"v":3}]})",
+               R"({"items":[{"id":3,"v":0},{"id":4,"v":4},{"id":1,"v":1}]})",
+               filter);
+}
+
+TEST_CASE(stream_random_documents) {
+  std::mt19937 rng(7);
+  json_utils::DiffFilter plain, keyed;
+  keyed.add_array_key("**", "a");
+  for (int i = 0; i < 2000; ++i) {
+    json expected = random_value(rng, 0);
+    json actual = mutated(expected, rng, 0);
+    const auto &filter = i % 2 ? keyed : plain;
+    auto want = buffered(expected, actual, filter);
+    std::string body = actual.dump();
+    CHECK(streamed(expected, body, filter, 1 + rng() % 7) == want);
+  }
+}
+
+TEST_CASE(keyed_missing_elements_follow_the_actual_ones) {
+  json_utils::DiffFilter filter;
+  filter.add_array_key("items", "id");
+  auto diffs = buffered(json::parse(R"({"items":[{"id":1},{"id":2}]})"),
+                        json::parse(R"({"items":[{"id":3}]})"), filter);
+  // Added items[0] (id 3), then the missing ids 1 and 2 after it
+  CHECK(diffs == std::vector<std::string>({"0 items[0]", "1 items[1]",
+                                           "1 items[2]"}));
+  // A pattern keys the array it names, not those nested in its elements
+  diffs = buffered(json::parse(R"({"items":[{"id":1,"items":[{"id":1}]}]})"),
+                   json::parse(R"({"items":[{"id":1,"items":[{"id":2}]}]})"),
+                   filter);
+  CHECK(diffs == std::vector<std::string>({"2 items[0].items[0].id"}));
+}
@@ -0,0 +1,72 @@
+#include "check.hpp"
+#include "test_graph.hpp"
+
+namespace {
+
+using nlohmann::json;
+
+// a -> b, a -> c, (b, c) -> d -> e
+const json kDiamond = json::array({
+    {{"test_name", "a"}},
+    {{"test_name", "b"}, {"depends_on", "a"}},
+    {{"test_name", "c"}, {"depends_on", "a"}},
+    {{"test_name", "d"}, {"depends_on", {"b", "c"}}},
+    {{"test_name", "e"}, {"depends_on", "d"}},
+});
+
+bool build(test_graph::Graph &graph, const json &cases) {
+  std::vector<size_t> all;
+  for (size_t i = 0; i < cases.size(); ++i)
+    all.push_back(i);
+  std::string error;
+  return graph.build(cases, all, error);
+}
+
+} // namespace
+
+TEST_CASE(graph_failed_parent_skips_downstream) {
+  test_graph::Graph graph;
+  CHECK(build(graph, kDiamond));
+  CHECK(graph.roots() == std::vector<size_t>({0}));
+
+  auto released = graph.finish(0, true, json::object());
+  CHECK(released.ready == std::vector<size_t>({1, 2}));
+  CHECK(released.skipped.empty());
+
+  // d still waits for c
+  released = graph.finish(1, false, json::object());
+  CHECK(released.ready.empty());
+  CHECK(released.skipped.empty());
+
+  // Once c passes, d is skipped because of b, and e because of d's skip
+  released = graph.finish(2, true, json::object());
+  CHECK(released.ready.empty());
+  using Skipped = std::vector<std::pair<size_t, std::string>>;
+  CHECK(released.skipped == Skipped({{3, "b"}, {4, "b"}}));
+}
+
+TEST_CASE(graph_hands_extracted_values_down) {
+  test_graph::Graph graph;
+  CHECK(build(graph, kDiamond));
+  graph.finish(0, true, {{"token", "t"}, {"x", 0}});
+  graph.finish(1, true, {{"x", 1}});
+  auto released = graph.finish(2, true, {{"x", 2}, {"y", 2}});
+  CHECK(released.ready == std::vector<size_t>({3}));
+  // Parents merge in depends_on order: c overrides b
+  CHECK_EQ(graph.variables(3), json({{"token", "t"}, {"x", 2}, {"y", 2}}));
+
+  released = graph.finish(3, true, json::object());
+  CHECK(released.ready == std::vector<size_t>({4}));
+  CHECK_EQ(graph.variables(4)["token"], "t");
+}
+
+TEST_CASE(graph_rejects_bad_dependencies) {
+  test_graph::Graph cyclic;
+  CHECK(!build(cyclic, json::array({
+                           {{"test_name", "a"}, {"depends_on", "b"}},
+                           {{"test_name", "b"}, {"depends_on", "a"}},
+                       })));
+  test_graph::Graph unknown;
+  CHECK(!build(unknown,
+               json::array({{{"test_name", "a"}, {"depends_on", "zz"}}})));
+}
@@ -0,0 +1,110 @@
+#include "check.hpp"
+#include "test_runner.hpp"
+
+namespace {
+
+test_runner::LatencyBudget budget_of(const nlohmann::json &spec) {
+  test_runner::LatencyBudget budget;
+  std::string error;
+  CHECK(test_runner::parse_budget(spec, budget, error));
+  CHECK(error.empty());
+  return budget;
+}
+
+std::vector<double> one_to(int n) {
+  std::vector<double> samples;
+  for (int i = n; i >= 1; --i)
+    samples.push_back(i);
+  return samples;
+}
+
+} // namespace
+
+TEST_CASE(budget_parses_percentiles) {
+  auto budget = budget_of({{"max_latency_ms", 500},
+                           {"latency_budget", {{"p50", 100}, {"p99.9", 400}}}});
+  CHECK_EQ(budget.max_ms, 500);
+  CHECK_EQ(budget.percentiles.size(), 2u);
+
+  test_runner::LatencyBudget rejected;
+  std::string error;
+  CHECK(!test_runner::parse_budget({{"latency_budget", {{"p150", 1}}}},
+                                   rejected, error));
+  CHECK(!error.empty());
+  // A zero maximum would read as no maximum at all
+  error.clear();
+  CHECK(!test_runner::parse_budget({{"max_latency_ms", 0}}, rejected, error));
+  CHECK(!error.empty());
+}
+
+TEST_CASE(budget_uses_nearest_rank_percentiles) {
+  auto over = [](const std::string &key, double limit, int samples) {
+    std::stringstream log;
+    bool broken = test_runner::check_budget(
+        budget_of({{"latency_budget", {{key, limit}}}}), one_to(samples), log);
+    bool logged = log.str().find(key + " ") != std::string::npos;
+    CHECK_EQ(broken, logged);
+    return broken;
+  };
+  // p95 of 1..100 is the 95th smallest sample
+  CHECK(!over("p95", 95, 100));
+  CHECK(over("p95", 94, 100));
+  // p50 of four samples is the second, p99.9 of ten the largest
+  CHECK(!over("p50", 2, 4));
+  CHECK(over("p50", 1.5, 4));
+  CHECK(over("p99.9", 9.5, 10));
+}
+
+TEST_CASE(budget_checks_the_maximum) {
+  std::stringstream log;
+  auto budget = budget_of({{"max_latency_ms", 10}});
+  CHECK(!test_runner::check_budget(budget, {3, 10, 7}, log));
+  CHECK(test_runner::check_budget(budget, {3, 10.5, 7}, log));
+  CHECK(!test_runner::check_budget(budget, {}, log));
+}
+
+TEST_CASE(malformed_case_fails_without_throwing) {
+  using nlohmann::json;
+  for (const json &spec : {
+           json{{"test_name", "a"}, {"request_description", 5}},
+           json{{"test_name", "a"}},
+           json{{"test_name", "a"},
+                {"request_description", "r.json"},
+                {"expected_response", "e.json"},
+                {"ignore", {1}}},
+           json{{"test_name", "a"},
+                {"request_description", "r.json"},
+                {"expected_response", "e.json"},
+                {"array_key", {{"items", 1}}}},
+           json{{"test_name", "a"},
+                {"request_description", "r.json"},
+                {"expected_response", "e.json"},
+                {"stream", "yes"}},
+       }) {
+    std::stringstream log;
+    auto result = test_runner::run_test(spec, test_runner::RunOptions(), log);
+    CHECK(result.failed);
+    CHECK(log.str().find("Invalid test spec") != std::string::npos);
+  }
+}
+
+TEST_CASE(row_filled_fixture_paths_bypass_the_cache) {
+  using nlohmann::json;
+  json source = {{"test_name", "{{id}}"},
+                 {"request_description", "missing/{{id}}.json"},
+                 {"expected_response", "missing/expected.json"}};
+  json row = {{"id", 7}};
+  fixture_cache::FixtureCache fixtures;
+  test_runner::RunOptions options;
+  options.fixtures = &fixtures;
+  options.variables = &row;
+  options.source = &source;
+
+  std::stringstream log;
+  test_runner::run_test({{"test_name", "7"},
+                         {"request_description", "missing/7.json"},
+                         {"expected_response", "missing/expected.json"}},
+                        options, log);
+  // Only the fixture shared by every row went through the cache
+  CHECK_EQ(fixtures.stats().lookups, 1u);
+}